@@ -0,0 +1,326 @@
+/*
+Benchmark for sndadj: time each stage of speeding up the bundled samples, so
+changes to the hot loops can be judged by more than timing the command line.
+The library must be built with -DSNDADJ_PROFILE for the per-stage times.
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sndadj.h"
+#include "options.h"
+#include "wave.h"
+
+#define BUFFER_SIZE 4096
+#define MAX_RUNS 1000
+
+static char *defaultFiles[] = {"samples/mary2.wav", "samples/ibm2.wav", "samples/talking.wav"};
+static double speeds[] = {1.5, 2.0, 3.0, 5.0};
+
+#define NUM_DEFAULT_FILES (sizeof(defaultFiles)/sizeof(char *))
+#define NUM_SPEEDS (sizeof(speeds)/sizeof(double))
+
+// Options from the command line.
+static int numRuns = 5;
+static char *outFileName = "/dev/null";
+static streamOptions options;
+
+// The time each stage took on one run, in nanoseconds.  Other is the time
+// spent in the stream outside the profiled stages, mostly moving buffers.
+typedef struct {
+    long long read, pitch, filter, play, other, write;
+} stageTimes;
+
+// A clip, read into memory, and the output of the last run on it.
+typedef struct {
+    short *input, *output;
+    int inputLength, outputLength, outputSize;
+    int sampleRate, numChannels;
+} clip;
+
+// Return nanoseconds on a monotonic clock.
+static long long getNanoseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+// Read the whole input file into the clip.  Return false if it can't be read.
+static bool readClip(
+    clip *c,
+    char *fileName)
+{
+    waveFile file = openInputWaveFile(fileName, &c->sampleRate, &c->numChannels);
+    int size = 0, samplesRead;
+
+    if(file == NULL) {
+        return false;
+    }
+    c->inputLength = 0;
+    do {
+        if(c->inputLength + BUFFER_SIZE > size) {
+            size = size == 0? 1 << 20 : size*2;
+            c->input = (short *)realloc(c->input, size*c->numChannels*sizeof(short));
+            if(c->input == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                closeWaveFile(file);
+                return false;
+            }
+        }
+        samplesRead = readFromWaveFile(file, c->input + c->inputLength*c->numChannels,
+            BUFFER_SIZE);
+        c->inputLength += samplesRead;
+    } while(samplesRead > 0);
+    closeWaveFile(file);
+    return true;
+}
+
+// Move whatever output the stream has ready to the end of the clip's output.
+static bool readOutput(
+    sndadjStream stream,
+    clip *c)
+{
+    int available = sndadjSamplesAvailable(stream);
+
+    if(c->outputLength + available > c->outputSize) {
+        c->outputSize = (c->outputLength + available)*2;
+        c->output = (short *)realloc(c->output, c->outputSize*c->numChannels*sizeof(short));
+        if(c->output == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+    }
+    c->outputLength += sndadjReadSamplesFromStream(stream,
+        c->output + c->outputLength*c->numChannels, available);
+    return true;
+}
+
+// Run the clip through the stream, keeping all the output in memory.
+static bool processClip(
+    sndadjStream stream,
+    clip *c)
+{
+    int pos, numSamples;
+
+    c->outputLength = 0;
+    for(pos = 0; pos < c->inputLength; pos += numSamples) {
+        numSamples = c->inputLength - pos;
+        if(numSamples > BUFFER_SIZE) {
+            numSamples = BUFFER_SIZE;
+        }
+        if(!sndadjWriteSamplesToStream(stream, c->input + pos*c->numChannels, numSamples) ||
+                !readOutput(stream, c)) {
+            return false;
+        }
+    }
+    return sndadjFlushStream(stream) && readOutput(stream, c);
+}
+
+// Write the clip's output to the output file.
+static bool writeClip(
+    clip *c)
+{
+    waveFile file = openOutputWaveFile(outFileName, c->sampleRate, c->numChannels);
+    int pos, numSamples;
+
+    if(file == NULL) {
+        return false;
+    }
+    for(pos = 0; pos < c->outputLength; pos += numSamples) {
+        numSamples = c->outputLength - pos;
+        if(numSamples > BUFFER_SIZE) {
+            numSamples = BUFFER_SIZE;
+        }
+        writeToWaveFile(file, c->output + pos*c->numChannels, numSamples);
+    }
+    return closeWaveFile(file);
+}
+
+// Time one run of reading, adjusting and writing the file.
+static bool timeRun(
+    sndadjStream *streamPtr,
+    clip *c,
+    char *fileName,
+    double speed,
+    stageTimes *times,
+    long long *numSteps)
+{
+    sndadjProfile profile;
+    long long start, processTime;
+
+    start = getNanoseconds();
+    if(!readClip(c, fileName)) {
+        return false;
+    }
+    times->read = getNanoseconds() - start;
+    if(*streamPtr == NULL) {
+        *streamPtr = sndadjCreateStream(c->sampleRate, c->numChannels);
+        if(*streamPtr == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+        if(!applyStreamOptions(*streamPtr, &options)) {
+            return false;
+        }
+    } else {
+        sndadjResetStream(*streamPtr);
+    }
+    sndadjSetSpeed(*streamPtr, speed);
+    start = getNanoseconds();
+    if(!processClip(*streamPtr, c)) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    processTime = getNanoseconds() - start;
+    sndadjGetProfile(*streamPtr, &profile);
+    times->pitch = profile.pitchNanoseconds;
+    times->filter = profile.filterNanoseconds;
+    times->play = profile.playNanoseconds;
+    times->other = processTime - times->pitch - times->filter - times->play;
+    *numSteps = profile.numSteps;
+    start = getNanoseconds();
+    if(!writeClip(c)) {
+        return false;
+    }
+    times->write = getNanoseconds() - start;
+    return true;
+}
+
+// Compare two times for qsort.
+static int compareTimes(
+    const void *a,
+    const void *b)
+{
+    long long difference = *(const long long *)a - *(const long long *)b;
+
+    return difference < 0? -1 : difference > 0;
+}
+
+// Return the median of one field of the stage times over all the runs.
+static long long medianTime(
+    stageTimes *runs,
+    int offset)
+{
+    long long values[MAX_RUNS];
+    int i;
+
+    for(i = 0; i < numRuns; i++) {
+        values[i] = *(long long *)((char *)(runs + i) + offset);
+    }
+    qsort(values, numRuns, sizeof(long long), compareTimes);
+    return values[numRuns/2];
+}
+
+// Run the file at the speed once to warm up, and then numRuns more times, and
+// report the median time of each stage.
+static bool benchmark(
+    clip *c,
+    char *fileName,
+    double speed,
+    stageTimes *total)
+{
+    stageTimes runs[MAX_RUNS], median;
+    sndadjStream stream = NULL;
+    long long numSteps, sum;
+    double outputLength;
+    bool passed;
+    int i;
+
+    passed = timeRun(&stream, c, fileName, speed, runs, &numSteps);
+    for(i = 0; passed && i < numRuns; i++) {
+        passed = timeRun(&stream, c, fileName, speed, runs + i, &numSteps);
+    }
+    if(stream != NULL) {
+        sndadjDestroyStream(stream);
+    }
+    if(!passed) {
+        fprintf(stderr, "Failed to benchmark %s\n", fileName);
+        return false;
+    }
+    median.read = medianTime(runs, offsetof(stageTimes, read));
+    median.pitch = medianTime(runs, offsetof(stageTimes, pitch));
+    median.filter = medianTime(runs, offsetof(stageTimes, filter));
+    median.play = medianTime(runs, offsetof(stageTimes, play));
+    median.other = medianTime(runs, offsetof(stageTimes, other));
+    median.write = medianTime(runs, offsetof(stageTimes, write));
+    sum = median.read + median.pitch + median.filter + median.play + median.other +
+        median.write;
+    outputLength = c->outputLength > 0? c->outputLength : 1;
+    printf("%-20s %5.2f %7.1f %7.1f %7.1f %7.1f %7.1f %7.1f %8.1f %9.2f %9.0f\n",
+        strrchr(fileName, '/') != NULL? strrchr(fileName, '/') + 1 : fileName, speed,
+        median.read/outputLength, median.pitch/outputLength, median.filter/outputLength,
+        median.play/outputLength, median.other/outputLength, median.write/outputLength,
+        sum/outputLength, c->inputLength*1.0e3/sum,
+        numSteps*1.0e9/(median.pitch + median.filter + median.play + median.other));
+    total->read += median.read;
+    total->pitch += median.pitch;
+    total->filter += median.filter;
+    total->play += median.play;
+    total->other += median.other;
+    total->write += median.write;
+    return true;
+}
+
+// Print usage and exit.
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sndadj_bench [OPTIONS] [wavFile ...]\n"
+        "    Time each stage of sndadj on the wave files at speeds 1.5 to 5.  The\n"
+        "    default files are the bundled samples.  Times are medians over the\n"
+        "    runs, after one warm-up run, in ns per output sample.\n"
+        "    -n runs   -- Number of timed runs.  Defaults to 5.\n"
+        "    -o file   -- Write output here.  Defaults to /dev/null.\n"
+        STREAM_OPTIONS_USAGE);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char **fileNames = defaultFiles;
+    int numFiles = NUM_DEFAULT_FILES;
+    stageTimes total = {0, 0, 0, 0, 0, 0};
+    clip c = {NULL, NULL, 0, 0, 0, 0, 0};
+    bool passed = true;
+    int xArg = 1, file, speed;
+
+    initStreamOptions(&options);
+    while(xArg < argc && *(argv[xArg]) == '-') {
+        if(!strcmp(argv[xArg], "-n") && xArg + 1 < argc) {
+            numRuns = atoi(argv[++xArg]);
+            if(numRuns < 1 || numRuns > MAX_RUNS) {
+                usage();
+            }
+        } else if(!strcmp(argv[xArg], "-o") && xArg + 1 < argc) {
+            outFileName = argv[++xArg];
+        } else if(!parseStreamOption(&options, argc, argv, &xArg)) {
+            usage();
+        }
+        xArg++;
+    }
+    if(xArg < argc) {
+        fileNames = argv + xArg;
+        numFiles = argc - xArg;
+    }
+    printf("%-20s %5s %7s %7s %7s %7s %7s %7s %8s %9s %9s\n", "file", "speed", "read",
+        "pitch", "filter", "play", "other", "write", "ns/out", "Msamp/s", "steps/s");
+    for(file = 0; passed && file < numFiles; file++) {
+        for(speed = 0; passed && speed < NUM_SPEEDS; speed++) {
+            passed = benchmark(&c, fileNames[file], speeds[speed], &total);
+        }
+    }
+    if(passed && total.pitch + total.filter + total.play == 0) {
+        printf("No stage times: build the library with -DSNDADJ_PROFILE\n");
+    }
+    if(passed) {
+        printf("Total ms: read %.1f, pitch %.1f, filter %.1f, play %.1f, other %.1f, "
+            "write %.1f\n", total.read*1.0e-6, total.pitch*1.0e-6, total.filter*1.0e-6,
+            total.play*1.0e-6, total.other*1.0e-6, total.write*1.0e-6);
+    }
+    free(c.input);
+    free(c.output);
+    return passed? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/*
+A small in-place radix-2 complex FFT.  The twiddle factors and bit reversal
+permutation are computed once per plan, so a transform only does the butterflies.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "fft.h"
+
+struct fftPlanStruct {
+    int size;
+    int *bitReverse;
+    double *cosTable, *sinTable; // size/2 entries each
+};
+
+// Create a plan for transforms of size points.
+fftPlan createFFTPlan(
+    int size)
+{
+    fftPlan plan;
+    int i, j, bits = 0;
+
+    if(size < 2 || (size & (size - 1)) != 0) {
+        return NULL;
+    }
+    plan = (fftPlan)calloc(1, sizeof(struct fftPlanStruct));
+    if(plan == NULL) {
+        return NULL;
+    }
+    plan->size = size;
+    plan->bitReverse = (int *)calloc(size, sizeof(int));
+    plan->cosTable = (double *)calloc(size/2, sizeof(double));
+    plan->sinTable = (double *)calloc(size/2, sizeof(double));
+    if(plan->bitReverse == NULL || plan->cosTable == NULL || plan->sinTable == NULL) {
+        destroyFFTPlan(plan);
+        return NULL;
+    }
+    while((1 << bits) < size) {
+        bits++;
+    }
+    for(i = 0; i < size; i++) {
+        plan->bitReverse[i] = 0;
+        for(j = 0; j < bits; j++) {
+            if(i & (1 << j)) {
+                plan->bitReverse[i] |= 1 << (bits - 1 - j);
+            }
+        }
+    }
+    for(i = 0; i < size/2; i++) {
+        plan->cosTable[i] = cos(2.0*M_PI*i/size);
+        plan->sinTable[i] = sin(2.0*M_PI*i/size);
+    }
+    return plan;
+}
+
+// Free the plan.
+void destroyFFTPlan(
+    fftPlan plan)
+{
+    if(plan->bitReverse != NULL) {
+        free(plan->bitReverse);
+    }
+    if(plan->cosTable != NULL) {
+        free(plan->cosTable);
+    }
+    if(plan->sinTable != NULL) {
+        free(plan->sinTable);
+    }
+    free(plan);
+}
+
+// Return the transform size of the plan.
+int getFFTSize(
+    fftPlan plan)
+{
+    return plan->size;
+}
+
+// Transform real and imag in place, using iterative decimation in time.
+void computeFFT(
+    fftPlan plan,
+    double *real,
+    double *imag,
+    bool inverse)
+{
+    int size = plan->size;
+    int i, j, k, half, tableStep;
+    double sign = inverse? 1.0 : -1.0;
+    double wr, wi, tr, ti, temp;
+
+    for(i = 0; i < size; i++) {
+        j = plan->bitReverse[i];
+        if(j > i) {
+            temp = real[i]; real[i] = real[j]; real[j] = temp;
+            temp = imag[i]; imag[i] = imag[j]; imag[j] = temp;
+        }
+    }
+    for(half = 1; half < size; half <<= 1) {
+        tableStep = size/(2*half);
+        for(k = 0; k < half; k++) {
+            wr = plan->cosTable[k*tableStep];
+            wi = sign*plan->sinTable[k*tableStep];
+            for(i = k; i < size; i += 2*half) {
+                j = i + half;
+                tr = wr*real[j] - wi*imag[j];
+                ti = wr*imag[j] + wi*real[j];
+                real[j] = real[i] - tr;
+                imag[j] = imag[i] - ti;
+                real[i] += tr;
+                imag[i] += ti;
+            }
+        }
+    }
+    if(inverse) {
+        for(i = 0; i < size; i++) {
+            real[i] /= size;
+            imag[i] /= size;
+        }
+    }
+}
@@ -0,0 +1,17 @@
+/*
+A small in-place radix-2 complex FFT, used for the autocorrelation pitch engine.
+*/
+
+#include <stdbool.h>
+
+typedef struct fftPlanStruct *fftPlan;
+
+// Create a plan for transforms of size points, which must be a power of 2.
+// Return NULL if out of memory.
+fftPlan createFFTPlan(int size);
+void destroyFFTPlan(fftPlan plan);
+// Return the transform size of the plan.
+int getFFTSize(fftPlan plan);
+// Transform real and imag in place.  The inverse transform is scaled by
+// 1/size, so a forward transform followed by an inverse one is the identity.
+void computeFFT(fftPlan plan, double *real, double *imag, bool inverse);
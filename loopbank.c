@@ -0,0 +1,279 @@
+/*
+This file supports reading and writing loop bank files.  All values are little
+endian.  The header is:
+
+    00 - "SNDLOOPS"
+    08 - version (32 bits, currently 1)
+    12 - sample rate (32 bits)
+    16 - number of channels (32 bits)
+    20 - number of loops (32 bits, filled in when the file is closed)
+
+Each loop is then:
+
+    step size (16 bits)
+    period (16 bits)
+    period 16-bit samples for each channel, one channel after another
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "loopbank.h"
+
+#define LOOP_BANK_VERSION 1
+#define LOOP_BANK_HEADER_SIZE 24
+#define LOOP_BUF_LEN 4096
+
+struct loopBankStruct {
+    int numChannels;
+    int sampleRate;
+    FILE *file;
+    int numLoops; /* Loops written or still to be read */
+    int failed;
+    int isInput;
+};
+
+/* Write bytes to the file. */
+static void writeBytes(
+    loopBank bank,
+    void *bytes,
+    int length)
+{
+    if(bank->failed) {
+        return;
+    }
+    if(fwrite(bytes, sizeof(char), length, bank->file) != length) {
+        fprintf(stderr, "Unable to write to loop bank file\n");
+        bank->failed = 1;
+    }
+}
+
+/* Write an integer of length bytes in little endian order. */
+static void writeValue(
+    loopBank bank,
+    int value,
+    int length)
+{
+    unsigned char bytes[4];
+    int i;
+
+    for(i = 0; i < length; i++) {
+        bytes[i] = value;
+        value >>= 8;
+    }
+    writeBytes(bank, bytes, length);
+}
+
+/* Read an exact number of bytes from the file.  Return 0 if we could not. */
+static int readBytes(
+    loopBank bank,
+    void *bytes,
+    int length)
+{
+    if(bank->failed) {
+        return 0;
+    }
+    if(fread(bytes, sizeof(char), length, bank->file) != length) {
+        bank->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+/* Read a little endian integer of length bytes. */
+static int readValue(
+    loopBank bank,
+    int length)
+{
+    unsigned char bytes[4];
+    int value = 0, i;
+
+    if(!readBytes(bank, bytes, length)) {
+        return 0;
+    }
+    for(i = length - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+/* Close the file and free the loopBank. */
+static void closeFile(
+    loopBank bank)
+{
+    if(bank->file != NULL) {
+        fclose(bank->file);
+    }
+    free(bank);
+}
+
+/* Open a loop bank for reading. */
+loopBank openInputLoopBank(
+    char *fileName,
+    int *sampleRate,
+    int *numChannels)
+{
+    loopBank bank;
+    char magic[8];
+    FILE *file = fopen(fileName, "rb");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open loop bank %s for reading\n", fileName);
+        return NULL;
+    }
+    bank = (loopBank)calloc(1, sizeof(struct loopBankStruct));
+    if(bank == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        fclose(file);
+        return NULL;
+    }
+    bank->file = file;
+    bank->isInput = 1;
+    if(!readBytes(bank, magic, 8) || memcmp(magic, "SNDLOOPS", 8) ||
+            readValue(bank, 4) != LOOP_BANK_VERSION) {
+        fprintf(stderr, "%s is not a loop bank\n", fileName);
+        closeFile(bank);
+        return NULL;
+    }
+    bank->sampleRate = readValue(bank, 4);
+    bank->numChannels = readValue(bank, 4);
+    bank->numLoops = readValue(bank, 4);
+    if(bank->failed || bank->sampleRate <= 0 || bank->numChannels <= 0) {
+        fprintf(stderr, "Corrupt loop bank header in %s\n", fileName);
+        closeFile(bank);
+        return NULL;
+    }
+    *sampleRate = bank->sampleRate;
+    *numChannels = bank->numChannels;
+    return bank;
+}
+
+/* Open a loop bank for writing. */
+loopBank openOutputLoopBank(
+    char *fileName,
+    int sampleRate,
+    int numChannels)
+{
+    loopBank bank;
+    FILE *file = fopen(fileName, "wb");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open loop bank %s for writing\n", fileName);
+        return NULL;
+    }
+    bank = (loopBank)calloc(1, sizeof(struct loopBankStruct));
+    if(bank == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        fclose(file);
+        return NULL;
+    }
+    bank->file = file;
+    bank->sampleRate = sampleRate;
+    bank->numChannels = numChannels;
+    writeBytes(bank, "SNDLOOPS", 8);
+    writeValue(bank, LOOP_BANK_VERSION, 4);
+    writeValue(bank, sampleRate, 4);
+    writeValue(bank, numChannels, 4);
+    writeValue(bank, 0, 4);
+    if(bank->failed) {
+        closeFile(bank);
+        return NULL;
+    }
+    return bank;
+}
+
+/* Close the loop bank.  For output, fill in the number of loops.  Return 0 if
+   anything went wrong writing the file. */
+int closeLoopBank(
+    loopBank bank)
+{
+    int passed = 1;
+
+    if(!bank->isInput) {
+        if(fseek(bank->file, LOOP_BANK_HEADER_SIZE - 4, SEEK_SET) != 0) {
+            fprintf(stderr, "Failed to seek on loop bank file.\n");
+            passed = 0;
+        } else {
+            writeValue(bank, bank->numLoops, 4);
+        }
+        if(bank->failed) {
+            passed = 0;
+        }
+    }
+    closeFile(bank);
+    return passed;
+}
+
+/* Read the next loop.  Samples must have room for maxPeriod samples per channel,
+   and channel c is put at samples[c*maxPeriod].  Return 0 at the end of the
+   bank, or if the loop is corrupt. */
+int readLoop(
+    loopBank bank,
+    int *stepSize,
+    int *period,
+    short *samples,
+    int maxPeriod)
+{
+    unsigned char bytes[LOOP_BUF_LEN];
+    short *p;
+    int channel, i, j, length;
+
+    if(bank->numLoops == 0) {
+        return 0;
+    }
+    *stepSize = readValue(bank, 2);
+    *period = readValue(bank, 2);
+    if(bank->failed || *stepSize <= 0 || *period <= 0 || *period > maxPeriod) {
+        fprintf(stderr, "Corrupt loop in loop bank\n");
+        return 0;
+    }
+    for(channel = 0; channel < bank->numChannels; channel++) {
+        p = samples + channel*maxPeriod;
+        for(i = 0; i < *period; i += length) {
+            length = *period - i;
+            if(length > LOOP_BUF_LEN/2) {
+                length = LOOP_BUF_LEN/2;
+            }
+            if(!readBytes(bank, bytes, 2*length)) {
+                fprintf(stderr, "Loop bank is truncated\n");
+                return 0;
+            }
+            for(j = 0; j < length; j++) {
+                *p++ = bytes[2*j] | (bytes[2*j + 1] << 8);
+            }
+        }
+    }
+    bank->numLoops--;
+    return 1;
+}
+
+/* Write a loop.  Channel c of the samples starts at samples[c*stride].  Return
+   1 if the file could not be written. */
+int writeLoop(
+    loopBank bank,
+    int stepSize,
+    int period,
+    const short *samples,
+    int stride)
+{
+    unsigned char bytes[LOOP_BUF_LEN];
+    const short *p;
+    int channel, i, bytePos;
+
+    writeValue(bank, stepSize, 2);
+    writeValue(bank, period, 2);
+    for(channel = 0; channel < bank->numChannels; channel++) {
+        p = samples + channel*stride;
+        bytePos = 0;
+        for(i = 0; i < period; i++) {
+            if(bytePos == LOOP_BUF_LEN) {
+                writeBytes(bank, bytes, bytePos);
+                bytePos = 0;
+            }
+            bytes[bytePos++] = p[i];
+            bytes[bytePos++] = p[i] >> 8;
+        }
+        writeBytes(bank, bytes, bytePos);
+    }
+    bank->numLoops++;
+    return bank->failed;
+}
@@ -0,0 +1,11 @@
+/* Support for reading and writing loop bank files.  A loop bank holds the
+   filters sndadj computes for a clip, which do not depend on the playback
+   speed, so one analysis can be rendered at any number of speeds. */
+
+typedef struct loopBankStruct *loopBank;
+
+loopBank openInputLoopBank(char *fileName, int *sampleRate, int *numChannels);
+loopBank openOutputLoopBank(char *fileName, int sampleRate, int numChannels);
+int closeLoopBank(loopBank bank);
+int readLoop(loopBank bank, int *stepSize, int *period, short *samples, int maxPeriod);
+int writeLoop(loopBank bank, int stepSize, int period, const short *samples, int stride);
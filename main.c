@@ -0,0 +1,907 @@
+/*
+Command line interface to sndadj: speed up or slow down a wave file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sndadj.h"
+#include "pool.h"
+#include "loopbank.h"
+#include "options.h"
+#include "seekindex.h"
+#include "wave.h"
+
+#define BUFFER_SIZE 4096
+#define MAX_LINE 4096
+#define MAX_SPEEDS 64
+
+// Options from the command line.
+static int numThreads = 0;
+static streamOptions options;
+static bool verbose = false;
+static seekIndex seekTable = NULL;
+static int seekSampleRate, seekNumChannels; // Of the input seekTable was made for
+static double speedRamp = 0.05;
+
+// One line of a speed map: play at speed from time seconds into the input on.
+typedef struct {
+    double time;
+    double speed;
+} speedChange;
+
+static speedChange *speedMap = NULL;
+static int speedMapLength = 0;
+
+// Print the pitch track.
+static void printPitch(
+    void *userData,
+    const sndadjPitchTrace *trace)
+{
+    printf("Period %d, minDiff %lld, aveDiff %lld%s\n", trace->period,
+        trace->minDiff, trace->aveDiff, trace->voiced? ", voiced" : "");
+}
+
+// Apply the command line options to a new stream.
+static bool configureStream(
+    sndadjStream stream)
+{
+    if(!applyStreamOptions(stream, &options)) {
+        return false;
+    }
+    if(verbose) {
+        sndadjSetTraceCallback(stream, printPitch, NULL);
+    }
+    sndadjSetSpeedRamp(stream, speedRamp);
+    return true;
+}
+
+// Write whatever output the stream has ready at each speed to the output file
+// for that speed.
+static void writeOutput(
+    sndadjStream stream,
+    waveFile *outFiles)
+{
+    short buffer[BUFFER_SIZE];
+    int samplesRead, i;
+
+    for(i = 0; i < sndadjGetNumSpeeds(stream); i++) {
+        do {
+            samplesRead = sndadjReadSamplesAtSpeed(stream, i, buffer,
+                BUFFER_SIZE/sndadjGetNumChannels(stream));
+            writeToWaveFile(outFiles[i], buffer, samplesRead);
+        } while(samplesRead > 0);
+    }
+}
+
+// Return true if the library accepts this speed.  This is false for NaN.
+static bool isValidSpeed(
+    double speed)
+{
+    return speed >= SNDADJ_MIN_SPEED && speed <= SNDADJ_MAX_SPEED;
+}
+
+// Parse a comma separated list of speeds, such as 1.25,1.5,2.  Return the
+// number of speeds, or 0 if the list is invalid.
+static int parseSpeeds(
+    char *text,
+    double *speeds)
+{
+    char *end;
+    int numSpeeds = 0;
+
+    do {
+        if(numSpeeds == MAX_SPEEDS) {
+            return 0;
+        }
+        speeds[numSpeeds] = strtod(text, &end);
+        if(end == text || !isValidSpeed(speeds[numSpeeds]) ||
+                (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        numSpeeds++;
+        text = end + 1;
+    } while(*end == ',');
+    return numSpeeds;
+}
+
+// Open an output file for each speed.  With one speed, the output file is
+// outFileName.  With more, the speed is added before the extension, so out.wav
+// at speeds 1.5 and 2 becomes out_1.5.wav and out_2.wav.  Return false if any
+// of them can't be opened.
+static bool openOutputs(
+    waveFile *outFiles,
+    char *outFileName,
+    double *speeds,
+    int numSpeeds,
+    int sampleRate,
+    int numChannels)
+{
+    char fileName[MAX_LINE];
+    char *extension, *slash;
+    int i, j;
+
+    extension = strrchr(outFileName, '.');
+    slash = strrchr(outFileName, '/');
+    if(extension == NULL || (slash != NULL && extension < slash)) {
+        extension = outFileName + strlen(outFileName);
+    }
+    for(i = 0; i < numSpeeds; i++) {
+        if(numSpeeds == 1) {
+            outFiles[i] = openOutputWaveFile(outFileName, sampleRate, numChannels);
+        } else {
+            snprintf(fileName, MAX_LINE, "%.*s_%g%s", (int)(extension - outFileName),
+                outFileName, speeds[i], extension);
+            outFiles[i] = openOutputWaveFile(fileName, sampleRate, numChannels);
+        }
+        if(outFiles[i] == NULL) {
+            for(j = 0; j < i; j++) {
+                closeWaveFile(outFiles[j]);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// Close the output file for each speed.  Return false if any of them fail.
+static bool closeOutputs(
+    waveFile *outFiles,
+    int numSpeeds)
+{
+    bool passed = true;
+    int i;
+
+    for(i = 0; i < numSpeeds; i++) {
+        if(!closeWaveFile(outFiles[i])) {
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// Make *streamPtr a fresh stream for the given format.  An existing stream is
+// reset and reused if it has the right format, so a worker processing many
+// files only allocates its buffers once.
+static bool getStream(
+    sndadjStream *streamPtr,
+    int sampleRate,
+    int numChannels)
+{
+    sndadjStream stream = *streamPtr;
+
+    if(stream != NULL && sndadjGetSampleRate(stream) == sampleRate &&
+            sndadjGetNumChannels(stream) == numChannels) {
+        sndadjResetStream(stream);
+        return true;
+    }
+    if(stream != NULL) {
+        sndadjDestroyStream(stream);
+    }
+    *streamPtr = stream = sndadjCreateStream(sampleRate, numChannels);
+    if(stream == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if(!configureStream(stream)) {
+        sndadjDestroyStream(stream);
+        *streamPtr = NULL;
+        return false;
+    }
+    return true;
+}
+
+// An input wave file.  We memory map the file if we can, and fall back on
+// reading it through stdio if not.
+typedef struct {
+    mappedWaveFile mapped;
+    const short *samples;
+    int numSamples, pos, numChannels;
+    waveFile file;
+    short buffer[BUFFER_SIZE];
+} inputFile;
+
+// Open an input file.  Return false if it can't be opened.
+static bool openInput(
+    inputFile *input,
+    char *fileName,
+    int *sampleRate,
+    int *numChannels)
+{
+    input->pos = 0;
+    input->file = NULL;
+    input->mapped = openMappedWaveFile(fileName, sampleRate, numChannels);
+    if(input->mapped != NULL) {
+        input->samples = getMappedWaveSamples(input->mapped, &input->numSamples);
+        input->numChannels = *numChannels;
+        return true;
+    }
+    input->file = openInputWaveFile(fileName, sampleRate, numChannels);
+    input->numChannels = *numChannels;
+    return input->file != NULL;
+}
+
+// Close an input file.
+static void closeInput(
+    inputFile *input)
+{
+    if(input->mapped != NULL) {
+        closeMappedWaveFile(input->mapped);
+    } else {
+        closeWaveFile(input->file);
+    }
+}
+
+// Set *samples to the next block of up to maxSamples frames of input.  Mapped
+// input is returned in place.  Return the number of frames, which is 0 at the
+// end of the file.
+static int readInput(
+    inputFile *input,
+    int maxSamples,
+    const short **samples)
+{
+    int numSamples;
+
+    if(input->mapped == NULL) {
+        *samples = input->buffer;
+        return readFromWaveFile(input->file, input->buffer, maxSamples);
+    }
+    numSamples = input->numSamples - input->pos;
+    if(numSamples > maxSamples) {
+        numSamples = maxSamples;
+    }
+    *samples = input->samples + (long long)input->pos*input->numChannels;
+    input->pos += numSamples;
+    return numSamples;
+}
+
+// Restart the stream at the last seek point at or before inputPos, and skip the
+// input to it.  Nothing before the seek point is analyzed.  Return false if
+// the input can't be seeked.
+static bool seekInputFile(
+    sndadjStream stream,
+    inputFile *input,
+    long long inputPos)
+{
+    const sndadjSeekPoint *point = findSeekPoint(seekTable, inputPos);
+    int historyLength;
+
+    if(sndadjGetSampleRate(stream) != seekSampleRate ||
+            sndadjGetNumChannels(stream) != seekNumChannels) {
+        fprintf(stderr, "The seek index does not match the input file\n");
+        return false;
+    }
+    if(point == NULL) {
+        return true;
+    }
+    if(input->mapped == NULL) {
+        fprintf(stderr, "Unable to seek in an input file that can't be memory mapped\n");
+        return false;
+    }
+    if(point->inputPos > input->numSamples) {
+        fprintf(stderr, "The seek index does not match the input file\n");
+        return false;
+    }
+    historyLength = point->inputPos < sndadjGetMaxPeriod(stream)?
+        point->inputPos : sndadjGetMaxPeriod(stream);
+    if(!sndadjSeekStream(stream, point, input->samples + point->inputPos*input->numChannels,
+            historyLength)) {
+        fprintf(stderr, "Invalid seek point in the seek index\n");
+        return false;
+    }
+    input->pos = point->inputPos;
+    return true;
+}
+
+// Feed the whole input file to the stream, writing output for each speed as it
+// becomes available if outFiles is not NULL.  Speed map changes are made when
+// we write the input at their time.  Playback lags the input written by the
+// pitch search lookahead of a couple of periods, so changes are heard that much
+// early, but the ramp makes that hard to notice.  Return the number of input
+// samples, or -1 if out of memory.
+static long long processInputFile(
+    sndadjStream stream,
+    inputFile *input,
+    waveFile *outFiles)
+{
+    const short *samples;
+    int samplesRead, maxSamples, nextChange = 0;
+    long long length = 0, changePos;
+    long long inputPos = input->pos;
+    bool passed;
+
+    do {
+        maxSamples = BUFFER_SIZE/input->numChannels;
+        while(nextChange < speedMapLength) {
+            changePos = (long long)(speedMap[nextChange].time*sndadjGetSampleRate(stream));
+            if(changePos > inputPos) {
+                if(changePos - inputPos < maxSamples) {
+                    maxSamples = changePos - inputPos;
+                }
+                break;
+            }
+            sndadjSetSpeed(stream, speedMap[nextChange].speed);
+            nextChange++;
+        }
+        samplesRead = readInput(input, maxSamples, &samples);
+        length += samplesRead;
+        inputPos += samplesRead;
+        if(samplesRead > 0) {
+            passed = sndadjWriteSamplesToStream(stream, samples, samplesRead);
+        } else {
+            passed = sndadjFlushStream(stream);
+        }
+        if(!passed) {
+            fprintf(stderr, "Out of memory, or the step is too short for the speed\n");
+            return -1;
+        }
+        if(outFiles != NULL) {
+            writeOutput(stream, outFiles);
+        }
+    } while(samplesRead > 0);
+    return length;
+}
+
+// Stream the input file through the speed adjuster into an output file for
+// each speed.  The input is only analyzed once, however many speeds there are.
+// If seekTime is not 0, start from that many seconds into the input, using the
+// seek index.  Set *lengthPtr to the number of input samples, and
+// *sampleRatePtr to the input's sample rate.
+static bool adjustWaveFile(
+    sndadjStream *streamPtr,
+    double *speeds,
+    int numSpeeds,
+    double seekTime,
+    char *inFileName,
+    char *outFileName,
+    long long *lengthPtr,
+    int *sampleRatePtr)
+{
+    inputFile input;
+    int sampleRate, numChannels;
+    long long length = -1;
+    waveFile outFiles[MAX_SPEEDS];
+    bool passed;
+
+    if(!openInput(&input, inFileName, &sampleRate, &numChannels)) {
+        return false;
+    }
+    if(!openOutputs(outFiles, outFileName, speeds, numSpeeds, sampleRate, numChannels)) {
+        closeInput(&input);
+        return false;
+    }
+    if(getStream(streamPtr, sampleRate, numChannels)) {
+        if(!sndadjSetSpeeds(*streamPtr, speeds, numSpeeds)) {
+            fprintf(stderr, "Out of memory\n");
+        } else if(seekTime == 0.0 ||
+                seekInputFile(*streamPtr, &input, (long long)(seekTime*sampleRate))) {
+            length = processInputFile(*streamPtr, &input, outFiles);
+        }
+    }
+    passed = length >= 0;
+    closeInput(&input);
+    if(!closeOutputs(outFiles, numSpeeds)) {
+        passed = false;
+    }
+    *lengthPtr = length;
+    *sampleRatePtr = sampleRate;
+    return passed;
+}
+
+// Save each loop the stream computes to the loop bank.
+static void saveLoop(
+    void *userData,
+    int stepSize,
+    int period,
+    const short *samples,
+    int stride)
+{
+    writeLoop((loopBank)userData, stepSize, period, samples, stride);
+}
+
+// Analyze the input file, and save the loops to a loop bank file, without
+// generating any audio.
+static bool analyzeWaveFile(
+    char *inFileName,
+    char *bankFileName)
+{
+    inputFile input;
+    int sampleRate, numChannels;
+    sndadjStream stream = NULL;
+    loopBank bank;
+    bool passed = false;
+
+    if(!openInput(&input, inFileName, &sampleRate, &numChannels)) {
+        return false;
+    }
+    bank = openOutputLoopBank(bankFileName, sampleRate, numChannels);
+    if(bank == NULL) {
+        closeInput(&input);
+        return false;
+    }
+    if(getStream(&stream, sampleRate, numChannels)) {
+        sndadjSetAnalysisOnly(stream, true);
+        sndadjSetLoopCallback(stream, saveLoop, bank);
+        passed = processInputFile(stream, &input, NULL) >= 0;
+        sndadjDestroyStream(stream);
+    }
+    closeInput(&input);
+    if(!closeLoopBank(bank)) {
+        passed = false;
+    }
+    return passed;
+}
+
+// The seek index being built, and whether we ran out of memory adding to it.
+typedef struct {
+    seekIndex index;
+    bool outOfMemory;
+} indexBuilder;
+
+// Add each seek point the stream reports to the seek index.  The stream can't
+// be stopped from its callback, so a failure is only noted here.
+static void saveSeekPoint(
+    void *userData,
+    const sndadjSeekPoint *point)
+{
+    indexBuilder *builder = (indexBuilder *)userData;
+
+    if(!builder->outOfMemory && !addSeekPoint(builder->index, point)) {
+        builder->outOfMemory = true;
+    }
+}
+
+// Analyze the input file, and save a seek point for each step to a seek index
+// file.
+static bool indexWaveFile(
+    char *inFileName,
+    char *indexFileName)
+{
+    inputFile input;
+    int sampleRate, numChannels;
+    sndadjStream stream = NULL;
+    seekIndex index;
+    indexBuilder builder;
+    bool passed = false;
+
+    if(!openInput(&input, inFileName, &sampleRate, &numChannels)) {
+        return false;
+    }
+    index = createSeekIndex(sampleRate, numChannels);
+    if(index == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        closeInput(&input);
+        return false;
+    }
+    if(getStream(&stream, sampleRate, numChannels)) {
+        sndadjSetAnalysisOnly(stream, true);
+        builder.index = index;
+        builder.outOfMemory = false;
+        sndadjSetSeekCallback(stream, saveSeekPoint, &builder);
+        passed = processInputFile(stream, &input, NULL) >= 0;
+        sndadjDestroyStream(stream);
+        if(builder.outOfMemory) {
+            fprintf(stderr, "Out of memory\n");
+            passed = false;
+        }
+    }
+    closeInput(&input);
+    if(passed) {
+        passed = writeSeekIndex(index, indexFileName);
+    }
+    destroySeekIndex(index);
+    return passed;
+}
+
+// Play the loops in a loop bank file at each of the speeds.
+static bool renderLoopBank(
+    double *speeds,
+    int numSpeeds,
+    char *bankFileName,
+    char *outFileName)
+{
+    short *samples;
+    int sampleRate, numChannels, stepSize, period, maxPeriod;
+    sndadjStream stream = NULL;
+    loopBank bank;
+    waveFile outFiles[MAX_SPEEDS];
+    bool passed = false;
+
+    bank = openInputLoopBank(bankFileName, &sampleRate, &numChannels);
+    if(bank == NULL) {
+        return false;
+    }
+    if(!openOutputs(outFiles, outFileName, speeds, numSpeeds, sampleRate, numChannels)) {
+        closeLoopBank(bank);
+        return false;
+    }
+    if(getStream(&stream, sampleRate, numChannels)) {
+        maxPeriod = sndadjGetMaxPeriod(stream);
+        samples = (short *)calloc(maxPeriod*numChannels, sizeof(short));
+        passed = samples != NULL && sndadjSetSpeeds(stream, speeds, numSpeeds);
+        while(passed && readLoop(bank, &stepSize, &period, samples, maxPeriod)) {
+            passed = sndadjWriteLoopToStream(stream, stepSize, period, samples, maxPeriod);
+            if(!passed) {
+                fprintf(stderr, "Unable to play a loop of period %d and step %d\n",
+                    period, stepSize);
+            }
+            writeOutput(stream, outFiles);
+        }
+        if(samples != NULL) {
+            free(samples);
+        }
+        sndadjDestroyStream(stream);
+    }
+    if(!closeLoopBank(bank)) {
+        passed = false;
+    }
+    if(!closeOutputs(outFiles, numSpeeds)) {
+        passed = false;
+    }
+    return passed;
+}
+
+// One line of a batch manifest.
+typedef struct {
+    double speed;
+    char *inFileName, *outFileName;
+} batchJob;
+
+// What each batch worker owns.  Streams are kept between jobs.
+typedef struct {
+    sndadjStream stream;
+    long long numSamples;
+    double seconds; // Of input audio
+    int numFiles, numFailed;
+} batchWorker;
+
+typedef struct {
+    batchJob *jobs;
+    batchWorker *workers;
+} batchContext;
+
+// Run one job of a batch.
+static void runBatchJob(
+    void *data,
+    int workerIndex,
+    int jobIndex)
+{
+    batchContext *context = (batchContext *)data;
+    batchJob *job = context->jobs + jobIndex;
+    batchWorker *worker = context->workers + workerIndex;
+    long long length = 0;
+    int sampleRate = 0;
+
+    if(adjustWaveFile(&worker->stream, &job->speed, 1, 0.0, job->inFileName,
+            job->outFileName, &length, &sampleRate)) {
+        worker->numFiles++;
+        worker->numSamples += length;
+        worker->seconds += (double)length/sampleRate;
+    } else {
+        fprintf(stderr, "Failed to process %s\n", job->inFileName);
+        worker->numFailed++;
+    }
+}
+
+// Read a speed map of "seconds speed" lines, which must be in order of time.
+// Blank lines and lines starting with # are skipped.  Return false on error.
+static bool readSpeedMap(
+    char *fileName)
+{
+    char line[MAX_LINE];
+    char first;
+    int lineNum = 0, mapSize = 0;
+    double time, speed;
+    FILE *file = fopen(fileName, "r");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open speed map %s\n", fileName);
+        return false;
+    }
+    while(fgets(line, MAX_LINE, file) != NULL) {
+        lineNum++;
+        if(sscanf(line, " %c", &first) != 1 || first == '#') {
+            continue;
+        }
+        if(sscanf(line, "%lf %lf", &time, &speed) != 2 || time < 0.0 || !isValidSpeed(speed) ||
+                (speedMapLength > 0 && time < speedMap[speedMapLength - 1].time)) {
+            fprintf(stderr, "%s:%d: expected seconds speed, in order of time\n",
+                fileName, lineNum);
+            fclose(file);
+            return false;
+        }
+        if(speedMapLength == mapSize) {
+            mapSize = mapSize == 0? 64 : mapSize*2;
+            speedMap = (speedChange *)realloc(speedMap, mapSize*sizeof(speedChange));
+            if(speedMap == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                fclose(file);
+                return false;
+            }
+        }
+        speedMap[speedMapLength].time = time;
+        speedMap[speedMapLength].speed = speed;
+        speedMapLength++;
+    }
+    fclose(file);
+    return true;
+}
+
+// Free the jobs read from a manifest.
+static void freeJobs(
+    batchJob *jobs,
+    int numJobs)
+{
+    int i;
+
+    for(i = 0; i < numJobs; i++) {
+        free(jobs[i].inFileName);
+        free(jobs[i].outFileName);
+    }
+    free(jobs);
+}
+
+// Read a manifest of "speed inWavFile outWavFile" lines.  Blank lines and lines
+// starting with # are skipped.  Return the number of jobs, or -1 on error.
+static int readManifest(
+    char *fileName,
+    batchJob **jobsPtr)
+{
+    char line[MAX_LINE], inFileName[MAX_LINE], outFileName[MAX_LINE];
+    char first;
+    batchJob *jobs = NULL, *newJobs;
+    int numJobs = 0, jobsSize = 0, newSize, lineNum = 0;
+    bool failed = false;
+    double speed;
+    FILE *file = fopen(fileName, "r");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open manifest %s\n", fileName);
+        return -1;
+    }
+    while(fgets(line, MAX_LINE, file) != NULL) {
+        lineNum++;
+        if(sscanf(line, " %c", &first) != 1 || first == '#') {
+            continue;
+        }
+        if(sscanf(line, "%lf %s %s", &speed, inFileName, outFileName) != 3 ||
+                !isValidSpeed(speed)) {
+            fprintf(stderr, "%s:%d: expected speed inWavFile outWavFile\n", fileName,
+                lineNum);
+            failed = true;
+            break;
+        }
+        if(numJobs == jobsSize) {
+            newSize = jobsSize == 0? 64 : jobsSize*2;
+            newJobs = (batchJob *)realloc(jobs, newSize*sizeof(batchJob));
+            if(newJobs == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                failed = true;
+                break;
+            }
+            jobs = newJobs;
+            jobsSize = newSize;
+        }
+        jobs[numJobs].speed = speed;
+        jobs[numJobs].inFileName = strdup(inFileName);
+        jobs[numJobs].outFileName = strdup(outFileName);
+        numJobs++;
+        if(jobs[numJobs - 1].inFileName == NULL || jobs[numJobs - 1].outFileName == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            failed = true;
+            break;
+        }
+    }
+    fclose(file);
+    if(failed) {
+        freeJobs(jobs, numJobs);
+        return -1;
+    }
+    *jobsPtr = jobs;
+    return numJobs;
+}
+
+// Return seconds on a monotonic clock.
+static double getTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1.0e-9;
+}
+
+// Process every file in the manifest on a pool of threads, and report the
+// aggregate throughput.
+static bool runBatch(
+    char *manifestName)
+{
+    batchContext context;
+    batchWorker total = {NULL, 0, 0.0, 0, 0};
+    double startTime, elapsed;
+    int numJobs, i;
+    bool passed;
+
+    numJobs = readManifest(manifestName, &context.jobs);
+    if(numJobs < 0) {
+        return false;
+    }
+    if(numThreads <= 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    context.workers = (batchWorker *)calloc(numThreads, sizeof(batchWorker));
+    if(context.workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        freeJobs(context.jobs, numJobs);
+        return false;
+    }
+    startTime = getTime();
+    passed = runJobs(numJobs, numThreads, runBatchJob, &context);
+    elapsed = getTime() - startTime;
+    for(i = 0; i < numThreads; i++) {
+        if(context.workers[i].stream != NULL) {
+            sndadjDestroyStream(context.workers[i].stream);
+        }
+        total.numFiles += context.workers[i].numFiles;
+        total.numFailed += context.workers[i].numFailed;
+        total.numSamples += context.workers[i].numSamples;
+        total.seconds += context.workers[i].seconds;
+    }
+    freeJobs(context.jobs, numJobs);
+    free(context.workers);
+    if(!passed) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    printf("Processed %d files (%d failed) on %d threads in %.3f seconds\n",
+        total.numFiles, total.numFailed, numThreads, elapsed);
+    if(elapsed > 0.0) {
+        printf("%.1f files/sec, %.0f input samples/sec, %.1fX real time\n",
+            total.numFiles/elapsed, total.numSamples/elapsed, total.seconds/elapsed);
+    }
+    return total.numFailed == 0;
+}
+
+// Print usage and exit.
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sndadj [OPTIONS] speed inWavFile outWavFile\n"
+        "       sndadj [OPTIONS] --batch manifest\n"
+        "       sndadj [OPTIONS] --analyze inWavFile outLoopBank\n"
+        "       sndadj [OPTIONS] --render speed inLoopBank outWavFile\n"
+        "       sndadj [OPTIONS] --index inWavFile outSeekIndex\n"
+        "    speed is from 0.01 to 100.  It may be a comma separated list, such as\n"
+        "    1.25,1.5,2, to render every speed from one analysis.  Each output then\n"
+        "    has the speed added to its name, as in out_1.5.wav.\n"
+        "    --batch manifest -- Process each \"speed inWavFile outWavFile\" line of\n"
+        "                 the manifest on a pool of threads.\n"
+        "    -t threads -- Number of batch threads.  Defaults to the number of CPUs.\n"
+        "    --analyze  -- Save the loops for the input to a loop bank, which can be\n"
+        "                 rendered at any speed without analyzing it again.\n"
+        "    --render   -- Play a loop bank at the given speed.\n"
+        "    --index    -- Save a seek index for the input, so it can be played\n"
+        "                 from any point with -s.\n"
+        "    -s seconds -- Start playing this far into the input.\n"
+        "    -i index  -- The seek index made by --index for the input.\n"
+        "    -m speedMap -- Change speed through the file.  Each line of the map is\n"
+        "                 \"seconds speed\", and speed is used from that time on.\n"
+        "    -r seconds -- Ramp speed changes over this long.  Defaults to 0.05.\n"
+        STREAM_OPTIONS_USAGE
+        "    -v        -- Print the pitch track.\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *manifestName = NULL, *indexName = NULL, *speedMapName = NULL;
+    bool analyze = false, render = false, makeIndex = false;
+    double seekTime = 0.0;
+    sndadjStream stream = NULL;
+    double speeds[MAX_SPEEDS];
+    long long length;
+    int sampleRate, numSpeeds, xArg = 1;
+    bool passed;
+
+    initStreamOptions(&options);
+    while(xArg < argc && *(argv[xArg]) == '-') {
+        if(!strcmp(argv[xArg], "-v")) {
+            verbose = true;
+        } else if(!strcmp(argv[xArg], "-t")) {
+            xArg++;
+            if(xArg < argc) {
+                numThreads = atoi(argv[xArg]);
+            }
+        } else if(!strcmp(argv[xArg], "-s")) {
+            xArg++;
+            if(xArg < argc) {
+                seekTime = atof(argv[xArg]);
+            }
+        } else if(!strcmp(argv[xArg], "-i")) {
+            xArg++;
+            if(xArg < argc) {
+                indexName = argv[xArg];
+            }
+        } else if(!strcmp(argv[xArg], "-m")) {
+            xArg++;
+            if(xArg < argc) {
+                speedMapName = argv[xArg];
+            }
+        } else if(!strcmp(argv[xArg], "-r")) {
+            xArg++;
+            if(xArg < argc) {
+                speedRamp = atof(argv[xArg]);
+            }
+        } else if(!strcmp(argv[xArg], "--index")) {
+            makeIndex = true;
+        } else if(!strcmp(argv[xArg], "--analyze")) {
+            analyze = true;
+        } else if(!strcmp(argv[xArg], "--render")) {
+            render = true;
+        } else if(!strcmp(argv[xArg], "--batch")) {
+            xArg++;
+            if(xArg < argc) {
+                manifestName = argv[xArg];
+            }
+        } else if(!parseStreamOption(&options, argc, argv, &xArg)) {
+            usage();
+        }
+        xArg++;
+    }
+    if(manifestName != NULL) {
+        if(xArg != argc || speedMapName != NULL) {
+            usage();
+        }
+        return runBatch(manifestName)? 0 : 1;
+    }
+    if(analyze) {
+        if(argc - xArg != 2) {
+            usage();
+        }
+        return analyzeWaveFile(argv[xArg], argv[xArg + 1])? 0 : 1;
+    }
+    if(makeIndex) {
+        if(argc - xArg != 2) {
+            usage();
+        }
+        return indexWaveFile(argv[xArg], argv[xArg + 1])? 0 : 1;
+    }
+    if(argc - xArg != 3) {
+        usage();
+    }
+    numSpeeds = parseSpeeds(argv[xArg], speeds);
+    if(numSpeeds == 0) {
+        usage();
+    }
+    if(render) {
+        return renderLoopBank(speeds, numSpeeds, argv[xArg + 1], argv[xArg + 2])? 0 : 1;
+    }
+    if(seekTime < 0.0 || (seekTime > 0.0 && indexName == NULL) ||
+            (speedMapName != NULL && numSpeeds > 1)) {
+        usage();
+    }
+    if(speedMapName != NULL && !readSpeedMap(speedMapName)) {
+        return 1;
+    }
+    if(seekTime > 0.0) {
+        seekTable = readSeekIndex(indexName, &seekSampleRate, &seekNumChannels);
+        if(seekTable == NULL) {
+            return 1;
+        }
+    }
+    passed = adjustWaveFile(&stream, speeds, numSpeeds, seekTime, argv[xArg + 1],
+        argv[xArg + 2], &length, &sampleRate);
+    if(stream != NULL) {
+        sndadjDestroyStream(stream);
+    }
+    if(seekTable != NULL) {
+        destroySeekIndex(seekTable);
+    }
+    if(speedMap != NULL) {
+        free(speedMap);
+    }
+    if(passed) {
+        printf("Length = %lld, sample rate = %d Hz\n", length, sampleRate);
+    }
+    return passed? 0 : 1;
+}
@@ -0,0 +1,103 @@
+/*
+Parsing and applying the stream options the command line programs share.  Each
+program keeps its own options, and hands the rest to parseStreamOption.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+
+// Set the options to the library's defaults.
+void initStreamOptions(
+    streamOptions *options)
+{
+    options->decimation = 1;
+    options->pitchEngine = SNDADJ_PITCH_AMDF;
+    options->fixedPoint = false;
+    options->prunedSearch = false;
+    options->skipUnvoiced = false;
+    options->stepScale = 1.0;
+}
+
+// Parse one stream option.  The values are only checked when the library gets
+// them, in applyStreamOptions, other than the name of the pitch engine.
+bool parseStreamOption(
+    streamOptions *options,
+    int argc,
+    char **argv,
+    int *xArg)
+{
+    char *option = argv[*xArg];
+    char *value = *xArg + 1 < argc? argv[*xArg + 1] : NULL;
+
+    if(!strcmp(option, "-f")) {
+        options->fixedPoint = true;
+        return true;
+    }
+    if(!strcmp(option, "-p")) {
+        options->prunedSearch = true;
+        return true;
+    }
+    if(!strcmp(option, "-u")) {
+        options->skipUnvoiced = true;
+        return true;
+    }
+    if(value == NULL) {
+        return false;
+    }
+    if(!strcmp(option, "-d")) {
+        options->decimation = atoi(value);
+    } else if(!strcmp(option, "-e")) {
+        if(!strcmp(value, "yin")) {
+            options->pitchEngine = SNDADJ_PITCH_YIN;
+        } else if(!strcmp(value, "sliding")) {
+            options->pitchEngine = SNDADJ_PITCH_SLIDING;
+        } else if(!strcmp(value, "amdf")) {
+            options->pitchEngine = SNDADJ_PITCH_AMDF;
+        } else {
+            return false;
+        }
+    } else if(!strcmp(option, "-k")) {
+        options->stepScale = !strcmp(value, "auto")? 0.0 : atof(value);
+    } else {
+        return false;
+    }
+    (*xArg)++;
+    return true;
+}
+
+// Return true if the options are all the defaults.
+bool usingDefaultOptions(
+    const streamOptions *options)
+{
+    return options->decimation == 1 && options->pitchEngine == SNDADJ_PITCH_AMDF &&
+        !options->fixedPoint && !options->prunedSearch && !options->skipUnvoiced &&
+        options->stepScale == 1.0;
+}
+
+// Apply the options to a stream.
+bool applyStreamOptions(
+    sndadjStream stream,
+    const streamOptions *options)
+{
+    if(!sndadjSetDecimation(stream, options->decimation)) {
+        fprintf(stderr, "Invalid decimation factor %d\n", options->decimation);
+        return false;
+    }
+    if(!sndadjSetPitchEngine(stream, options->pitchEngine)) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if(!sndadjSetFixedPoint(stream, options->fixedPoint)) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if(!sndadjSetStepScale(stream, options->stepScale)) {
+        fprintf(stderr, "Invalid step scale %g\n", options->stepScale);
+        return false;
+    }
+    sndadjSetPrunedSearch(stream, options->prunedSearch);
+    sndadjSetSkipUnvoiced(stream, options->skipUnvoiced);
+    return true;
+}
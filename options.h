@@ -0,0 +1,41 @@
+/*
+The stream options shared by sndadj, sndadj_bench and sndadj_quality, so each
+program parses and applies -d, -e, -f, -p, -u and -k the same way.
+*/
+
+#include <stdbool.h>
+#include "sndadj.h"
+
+// Stream settings from the command line.
+typedef struct {
+    int decimation;
+    sndadjPitchEngine pitchEngine;
+    bool fixedPoint;
+    bool prunedSearch;
+    bool skipUnvoiced;
+    double stepScale; // 0 picks it from the speed
+} streamOptions;
+
+// The usage lines for the stream options, to add to each program's usage.
+#define STREAM_OPTIONS_USAGE \
+    "    -d factor -- Down-sample the pitch search by 1, 2 or 4, or pick\n" \
+    "                 the factor from the sample rate if 0.\n" \
+    "    -e engine -- Use the amdf (default), yin or sliding pitch estimator.\n" \
+    "                 Sliding only saves time with -k 0.5 or less.\n" \
+    "    -f        -- Use fixed point filters.\n" \
+    "    -p        -- Prune the amdf pitch search.\n" \
+    "    -u        -- Skip the pitch search on silence and unvoiced sounds.\n" \
+    "    -k scale  -- Step this many periods at a time, from 0.25 to 4, or auto\n" \
+    "                 to pick it from the speed.  Defaults to 1.\n"
+
+// Set the options to the library's defaults.
+void initStreamOptions(streamOptions *options);
+// Parse the option at argv[*xArg], and its argument if it takes one, leaving
+// *xArg on the last argument used.  Return false if it isn't a stream option,
+// or its argument is missing or invalid.
+bool parseStreamOption(streamOptions *options, int argc, char **argv, int *xArg);
+// Return true if the options are all the defaults.
+bool usingDefaultOptions(const streamOptions *options);
+// Apply the options to a stream.  Print why and return false if the library
+// refuses one.
+bool applyStreamOptions(sndadjStream stream, const streamOptions *options);
@@ -0,0 +1,151 @@
+/*
+A work-stealing thread pool.  Each worker starts with an equal contiguous range
+of jobs, and takes jobs from the front of its own range.  When a worker runs out,
+it steals the back half of the largest range left on any other worker, so a few
+long jobs at the end of one range don't leave the other threads idle.
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "pool.h"
+
+typedef struct workerStruct *worker;
+
+struct workerStruct {
+    pthread_mutex_t lock;
+    int next, end; // The jobs still to run on this worker
+    int index;
+    pthread_t thread;
+    worker workers; // The array of all workers
+    int numWorkers;
+    poolJobFunc func;
+    void *context;
+};
+
+// Take the next job from our own range.  Return -1 if there are none left.
+static int takeJob(
+    worker w)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&w->lock);
+    if(w->next < w->end) {
+        job = w->next++;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return job;
+}
+
+// Return the number of jobs left on a worker.
+static int jobsRemaining(
+    worker w)
+{
+    int remaining;
+
+    pthread_mutex_lock(&w->lock);
+    remaining = w->end - w->next;
+    pthread_mutex_unlock(&w->lock);
+    return remaining;
+}
+
+// Move the back half of the largest other range to this worker.  Return false
+// if every other worker is out of jobs.  We never hold two locks at once, so
+// thieves can't deadlock each other.
+static bool stealJobs(
+    worker w)
+{
+    worker victim;
+    int i, remaining, bestRemaining, numStolen, start;
+
+    while(true) {
+        victim = NULL;
+        bestRemaining = 0;
+        for(i = 0; i < w->numWorkers; i++) {
+            if(i != w->index) {
+                remaining = jobsRemaining(w->workers + i);
+                if(remaining > bestRemaining) {
+                    victim = w->workers + i;
+                    bestRemaining = remaining;
+                }
+            }
+        }
+        if(victim == NULL) {
+            return false;
+        }
+        pthread_mutex_lock(&victim->lock);
+        numStolen = (victim->end - victim->next + 1)/2;
+        victim->end -= numStolen;
+        start = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+        if(numStolen > 0) {
+            pthread_mutex_lock(&w->lock);
+            w->next = start;
+            w->end = start + numStolen;
+            pthread_mutex_unlock(&w->lock);
+            return true;
+        }
+        // Someone else got there first, so look again.
+    }
+}
+
+// The body of each worker thread.
+static void *runWorker(
+    void *data)
+{
+    worker w = (worker)data;
+    int job;
+
+    do {
+        while((job = takeJob(w)) >= 0) {
+            w->func(w->context, w->index, job);
+        }
+    } while(stealJobs(w));
+    return NULL;
+}
+
+// Run jobs 0 through numJobs - 1 on numThreads threads.  If some threads fail
+// to start, the others steal their jobs, and if none start, we run everything
+// on the calling thread.
+bool runJobs(
+    int numJobs,
+    int numThreads,
+    poolJobFunc func,
+    void *context)
+{
+    worker workers;
+    int i, started;
+
+    if(numThreads < 1) {
+        numThreads = 1;
+    }
+    workers = (worker)calloc(numThreads, sizeof(struct workerStruct));
+    if(workers == NULL) {
+        return false;
+    }
+    for(i = 0; i < numThreads; i++) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        workers[i].next = (long long)numJobs*i/numThreads;
+        workers[i].end = (long long)numJobs*(i + 1)/numThreads;
+        workers[i].index = i;
+        workers[i].workers = workers;
+        workers[i].numWorkers = numThreads;
+        workers[i].func = func;
+        workers[i].context = context;
+    }
+    for(started = 0; started < numThreads; started++) {
+        if(pthread_create(&workers[started].thread, NULL, runWorker, workers + started) != 0) {
+            break;
+        }
+    }
+    if(started == 0) {
+        runWorker(workers);
+    }
+    for(i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for(i = 0; i < numThreads; i++) {
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    free(workers);
+    return true;
+}
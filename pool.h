@@ -0,0 +1,12 @@
+/*
+A small work-stealing thread pool for running many independent jobs.
+*/
+
+#include <stdbool.h>
+
+// Called to run job number job on worker thread number worker.
+typedef void (*poolJobFunc)(void *context, int worker, int job);
+
+// Run jobs 0 through numJobs - 1 on numThreads threads, and wait for them all
+// to finish.  Return false if out of memory.
+bool runJobs(int numJobs, int numThreads, poolJobFunc func, void *context);
@@ -0,0 +1,647 @@
+/*
+Quality check for sndadj: render the bundled samples at each speed there are
+reference renders for, score the result against the sndadj_* and sonic_*
+references, and report the CPU time it took next to each score.  The scores
+are checked against a saved baseline, so a faster pitch search or mixing loop
+is only accepted if the quality stays within tolerance.
+
+The baseline for the sndadj and sonic references is the default settings, and
+renders with faster approximations such as decimation or fixed point are held
+to it too.  Those renders are also scored against our own default render, as
+the "self" reference, which shows how far the approximation moves the output.
+Each set of options has its own self baseline, named after the options, such
+as self-f.  With the default settings, the self score would compare a render
+with itself, so it is left out.
+
+Fixed point only changes the rounding of the filters and the mix, so with -f
+alone, the render must also match the double precision render in length, with
+an SNR over the whole clip of at least FIXED_POINT_MIN_SNR.
+
+Two scores are kept.  Segmental SNR averages the SNR of 20ms frames, clamped to
+[-10, 35] dB, over frames that are not silent.  It is only meaningful against
+renders by the same algorithm, since any change in the pitch track moves the
+waveform.  Log-spectral distance averages the RMS difference in dB between the
+power spectra of 50% overlapped Hann windowed frames, so it is insensitive to
+phase, and is the better score against sonic.  Against the sndadj and sonic
+references, only the log-spectral distance is checked: their segmental SNR is
+near -4 dB, and moves with the phase of the output rather than its quality.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "sndadj.h"
+#include "fft.h"
+#include "options.h"
+#include "wave.h"
+
+#define BUFFER_SIZE 4096
+#define MAX_LINE 4096
+#define MAX_CASES 512
+#define SEG_SNR_MIN -10.0
+#define SEG_SNR_MAX 35.0
+// Frames with less energy than this per sample are silent, and not scored.
+#define SILENCE_ENERGY 100.0
+// The most the scores may get worse than the baseline before we fail.  The
+// segmental SNR is only checked against self baselines.
+#define SEG_SNR_TOLERANCE 0.5
+#define LSD_TOLERANCE 0.2
+// With -f alone, the least SNR against the double render we accept.  It is
+// about 77 dB on the samples, from differences of one or two LSBs.
+#define FIXED_POINT_MIN_SNR 60.0
+// How far apart in time frames compared by the log-spectral distance may be.
+#define MAX_LAG_TIME 0.1
+
+static char *clipNames[] = {"mary2", "ibm2"};
+static char *speedNames[] = {"1.5", "2", "3", "4", "5"};
+// Self is our own render with the default options, which is the reference for
+// faster approximations.  Its name gets the options added, in selfName.  The
+// rest are the renders in samples.
+static char *referenceNames[] = {"self", "sndadj", "sonic"};
+
+#define NUM_CLIPS (sizeof(clipNames)/sizeof(char *))
+#define NUM_SPEEDS (sizeof(speedNames)/sizeof(char *))
+#define NUM_REFERENCES (sizeof(referenceNames)/sizeof(char *))
+
+// Options from the command line.
+static char *baselineName = "samples/quality.txt";
+static bool saveBaseline = false;
+static streamOptions options;
+static char selfName[32];
+
+// The scores of one render against one reference.
+typedef struct {
+    char clipName[32], speedName[32], referenceName[32];
+    double segSnr, lsd;
+} score;
+
+// Append whatever output the stream has ready to *output, growing it as
+// needed.  Return false if out of memory.
+static bool readOutput(
+    sndadjStream stream,
+    short **output,
+    int *outputLength,
+    int *outputSize)
+{
+    int available = sndadjSamplesAvailable(stream);
+
+    if(*outputLength + available > *outputSize) {
+        *outputSize = (*outputLength + available)*2;
+        *output = (short *)realloc(*output, *outputSize*sizeof(short));
+        if(*output == NULL) {
+            return false;
+        }
+    }
+    *outputLength += sndadjReadSamplesFromStream(stream, *output + *outputLength, available);
+    return true;
+}
+
+// Return true if the command line asked for the default stream settings.
+static bool usingDefaults(void)
+{
+    return usingDefaultOptions(&options);
+}
+
+// Name the self reference after the command line options, so each set of
+// options has its own baseline against the default render.
+static void setSelfName(void)
+{
+    char *engine = options.pitchEngine == SNDADJ_PITCH_YIN? "-yin" :
+        options.pitchEngine == SNDADJ_PITCH_SLIDING? "-sliding" : "";
+    char decimationName[8] = "", stepName[16] = "";
+
+    if(options.decimation != 1) {
+        snprintf(decimationName, sizeof(decimationName), "-d%d", options.decimation);
+    }
+    if(options.stepScale == 0.0) {
+        strcpy(stepName, "-kauto");
+    } else if(options.stepScale != 1.0) {
+        snprintf(stepName, sizeof(stepName), "-k%g", options.stepScale);
+    }
+    snprintf(selfName, sizeof(selfName), "self%s%s%s%s%s%s", decimationName, engine,
+        options.fixedPoint? "-f" : "", options.prunedSearch? "-p" : "",
+        options.skipUnvoiced? "-u" : "", stepName);
+}
+
+// Return true if fixed point is the only option that isn't the default.
+static bool onlyFixedPoint(void)
+{
+    streamOptions others = options;
+
+    others.fixedPoint = false;
+    return options.fixedPoint && usingDefaultOptions(&others);
+}
+
+// Render a whole mono clip at the given speed, with the command line options,
+// or with the default settings if useDefaults is true.  Set *outputLength to
+// the number of output samples, and *cpuTime to the CPU seconds it took.
+// Return NULL on failure.
+static short *render(
+    const short *input,
+    int inputLength,
+    int sampleRate,
+    double speed,
+    bool useDefaults,
+    int *outputLength,
+    double *cpuTime)
+{
+    sndadjStream stream = sndadjCreateStream(sampleRate, 1);
+    short *output = NULL;
+    int pos, numSamples, outputSize = 0;
+    clock_t start;
+    bool passed = true;
+
+    if(stream == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    if(!useDefaults && !applyStreamOptions(stream, &options)) {
+        sndadjDestroyStream(stream);
+        return NULL;
+    }
+    sndadjSetSpeed(stream, speed);
+    *outputLength = 0;
+    start = clock();
+    for(pos = 0; passed && pos < inputLength; pos += numSamples) {
+        numSamples = inputLength - pos;
+        if(numSamples > BUFFER_SIZE) {
+            numSamples = BUFFER_SIZE;
+        }
+        passed = sndadjWriteSamplesToStream(stream, input + pos, numSamples) &&
+            readOutput(stream, &output, outputLength, &outputSize);
+    }
+    if(passed) {
+        passed = sndadjFlushStream(stream) &&
+            readOutput(stream, &output, outputLength, &outputSize);
+    }
+    *cpuTime = (double)(clock() - start)/CLOCKS_PER_SEC;
+    sndadjDestroyStream(stream);
+    if(!passed) {
+        fprintf(stderr, "Out of memory\n");
+        if(output != NULL) {
+            free(output);
+        }
+        return NULL;
+    }
+    return output;
+}
+
+// Return the segmental SNR of test against reference.
+static double segmentalSnr(
+    const short *reference,
+    const short *test,
+    int length,
+    int sampleRate)
+{
+    int frameSize = sampleRate/50;
+    int numFrames = 0;
+    double signal, noise, difference, snr, total = 0.0;
+    int pos, i;
+
+    for(pos = 0; pos + frameSize <= length; pos += frameSize) {
+        signal = 0.0;
+        noise = 0.0;
+        for(i = pos; i < pos + frameSize; i++) {
+            difference = reference[i] - test[i];
+            signal += (double)reference[i]*reference[i];
+            noise += difference*difference;
+        }
+        if(signal < SILENCE_ENERGY*frameSize) {
+            continue;
+        }
+        snr = noise > 0.0? 10.0*log10(signal/noise) : SEG_SNR_MAX;
+        total += snr < SEG_SNR_MIN? SEG_SNR_MIN : snr > SEG_SNR_MAX? SEG_SNR_MAX : snr;
+        numFrames++;
+    }
+    return numFrames > 0? total/numFrames : SEG_SNR_MAX;
+}
+
+// Return the SNR of test against reference over the whole clip, in dB.
+static double overallSnr(
+    const short *reference,
+    const short *test,
+    int length)
+{
+    double signal = 0.0, noise = 0.0, difference;
+    int i;
+
+    for(i = 0; i < length; i++) {
+        difference = reference[i] - test[i];
+        signal += (double)reference[i]*reference[i];
+        noise += difference*difference;
+    }
+    return noise > 0.0? 10.0*log10(signal/noise) : INFINITY;
+}
+
+// Check a fixed point render against the double precision one, and print the
+// SNR.  Return false if the lengths differ or the SNR is too low.
+static bool checkFixedPoint(
+    char *clipName,
+    char *speedName,
+    const short *reference,
+    int refLength,
+    const short *test,
+    int testLength)
+{
+    double snr = overallSnr(reference, test, refLength < testLength? refLength : testLength);
+
+    if(refLength != testLength || snr < FIXED_POINT_MIN_SNR) {
+        printf("FAILED %s %s fixed point: SNR %.1f dB (minimum %.1f), length %d (double %d)\n",
+            clipName, speedName, snr, FIXED_POINT_MIN_SNR, testLength, refLength);
+        return false;
+    }
+    printf("%-8s %5s fixed point SNR against double: %.1f dB\n", clipName, speedName, snr);
+    return true;
+}
+
+// Window a frame and return its power spectrum in dB in spectrum, which must
+// have room for size/2 + 1 bins.  The power is floored at the level white noise
+// at the silence threshold would have, so rounding noise in nearly empty bins
+// does not count.  Return the energy of the frame.
+static double powerSpectrum(
+    fftPlan plan,
+    const short *samples,
+    double *window,
+    double *real,
+    double *imag,
+    double *spectrum)
+{
+    int size = getFFTSize(plan);
+    double noiseFloor = 0.375*size*SILENCE_ENERGY; // The Hann window's power is 0.375
+    double energy = 0.0;
+    int i;
+
+    for(i = 0; i < size; i++) {
+        energy += (double)samples[i]*samples[i];
+        real[i] = samples[i]*window[i];
+        imag[i] = 0.0;
+    }
+    computeFFT(plan, real, imag, false);
+    for(i = 0; i <= size/2; i++) {
+        spectrum[i] = 10.0*log10(real[i]*real[i] + imag[i]*imag[i] + noiseFloor);
+    }
+    return energy;
+}
+
+// Return the log-spectral distance between test and reference in dB, or -1 if
+// out of memory.  Renders by different algorithms drift apart in time by a
+// few periods, so each test frame is compared with the best matching reference
+// frame within MAX_LAG_TIME, searched in steps of an eighth of a frame.
+static double logSpectralDistance(
+    const short *reference,
+    int refLength,
+    const short *test,
+    int testLength,
+    int sampleRate)
+{
+    int size = 2, numFrames = 0, numRefFrames, hop, maxLag;
+    double *window, *real, *imag, *refSpectra, *refEnergies, *testSpectrum, *refSpectrum;
+    double testEnergy, difference, sum, minSum, total = 0.0;
+    fftPlan plan;
+    int pos, frame, bestFrame, first, last, i;
+
+    while(size < sampleRate/32) {
+        size <<= 1;
+    }
+    hop = size/8;
+    maxLag = (int)(MAX_LAG_TIME*sampleRate)/hop;
+    numRefFrames = refLength >= size? (refLength - size)/hop + 1 : 0;
+    plan = createFFTPlan(size);
+    window = (double *)calloc(size, sizeof(double));
+    real = (double *)calloc(size, sizeof(double));
+    imag = (double *)calloc(size, sizeof(double));
+    testSpectrum = (double *)calloc(size/2 + 1, sizeof(double));
+    refSpectra = (double *)calloc((long)numRefFrames*(size/2 + 1) + 1, sizeof(double));
+    refEnergies = (double *)calloc(numRefFrames + 1, sizeof(double));
+    if(plan == NULL || window == NULL || real == NULL || imag == NULL ||
+            testSpectrum == NULL || refSpectra == NULL || refEnergies == NULL) {
+        total = -1.0;
+    } else {
+        for(i = 0; i < size; i++) {
+            window[i] = 0.5 - 0.5*cos(2.0*M_PI*i/size);
+        }
+        for(frame = 0; frame < numRefFrames; frame++) {
+            refEnergies[frame] = powerSpectrum(plan, reference + frame*hop, window, real,
+                imag, refSpectra + (long)frame*(size/2 + 1));
+        }
+        for(pos = 0; pos + size <= testLength; pos += size/2) {
+            testEnergy = powerSpectrum(plan, test + pos, window, real, imag, testSpectrum);
+            first = pos/hop - maxLag < 0? 0 : pos/hop - maxLag;
+            last = pos/hop + maxLag >= numRefFrames? numRefFrames - 1 : pos/hop + maxLag;
+            minSum = -1.0;
+            bestFrame = first;
+            for(frame = first; frame <= last; frame++) {
+                refSpectrum = refSpectra + (long)frame*(size/2 + 1);
+                sum = 0.0;
+                for(i = 0; i <= size/2; i++) {
+                    difference = refSpectrum[i] - testSpectrum[i];
+                    sum += difference*difference;
+                }
+                if(minSum < 0.0 || sum < minSum) {
+                    minSum = sum;
+                    bestFrame = frame;
+                }
+            }
+            if(minSum < 0.0 || (testEnergy < SILENCE_ENERGY*size &&
+                    refEnergies[bestFrame] < SILENCE_ENERGY*size)) {
+                continue;
+            }
+            total += sqrt(minSum/(size/2 + 1));
+            numFrames++;
+        }
+        if(numFrames > 0) {
+            total /= numFrames;
+        }
+    }
+    if(plan != NULL) {
+        destroyFFTPlan(plan);
+    }
+    free(window);
+    free(real);
+    free(imag);
+    free(testSpectrum);
+    free(refSpectra);
+    free(refEnergies);
+    return total;
+}
+
+// Open a mono wave file in place.  Return NULL if we can't.
+static mappedWaveFile openClip(
+    char *fileName,
+    int *sampleRate,
+    const short **samples,
+    int *length)
+{
+    mappedWaveFile file;
+    int numChannels;
+
+    file = openMappedWaveFile(fileName, sampleRate, &numChannels);
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open %s\n", fileName);
+        return NULL;
+    }
+    if(numChannels != 1) {
+        fprintf(stderr, "%s is not mono\n", fileName);
+        closeMappedWaveFile(file);
+        return NULL;
+    }
+    *samples = getMappedWaveSamples(file, length);
+    return file;
+}
+
+// Render the clip at each speed, and score it against every reference.  Add
+// the number of fixed point renders too far from the double ones to
+// *numFailed.  Return the number of scores added, or -1 on failure.
+static int scoreClip(
+    char *clipName,
+    score *scores,
+    int *numFailed)
+{
+    char fileName[MAX_LINE];
+    mappedWaveFile inFile, refFile;
+    const short *input, *reference;
+    short *output, *selfOutput;
+    int sampleRate, refSampleRate, inputLength, outputLength, selfLength, refLength;
+    int length, numScores = 0, speed, ref;
+    double cpuTime, selfCpuTime;
+    score *s;
+
+    snprintf(fileName, MAX_LINE, "samples/%s.wav", clipName);
+    inFile = openClip(fileName, &sampleRate, &input, &inputLength);
+    if(inFile == NULL) {
+        return -1;
+    }
+    for(speed = 0; speed < NUM_SPEEDS; speed++) {
+        output = render(input, inputLength, sampleRate, atof(speedNames[speed]), false,
+            &outputLength, &cpuTime);
+        selfOutput = output;
+        selfLength = outputLength;
+        if(output != NULL && !usingDefaults()) {
+            selfOutput = render(input, inputLength, sampleRate, atof(speedNames[speed]),
+                true, &selfLength, &selfCpuTime);
+        }
+        if(output == NULL || selfOutput == NULL) {
+            closeMappedWaveFile(inFile);
+            return -1;
+        }
+        if(onlyFixedPoint() && !checkFixedPoint(clipName, speedNames[speed], selfOutput,
+                selfLength, output, outputLength)) {
+            (*numFailed)++;
+        }
+        for(ref = 0; ref < NUM_REFERENCES; ref++) {
+            refFile = NULL;
+            if(ref == 0 && usingDefaults()) {
+                continue;
+            } else if(ref == 0) {
+                reference = selfOutput;
+                refLength = selfLength;
+            } else {
+                snprintf(fileName, MAX_LINE, "samples/%s_%s_%s.wav", referenceNames[ref],
+                    clipName, speedNames[speed]);
+                refFile = openClip(fileName, &refSampleRate, &reference, &refLength);
+                if(refFile == NULL) {
+                    continue;
+                }
+            }
+            length = outputLength < refLength? outputLength : refLength;
+            s = scores + numScores++;
+            strcpy(s->clipName, clipName);
+            strcpy(s->speedName, speedNames[speed]);
+            strcpy(s->referenceName, ref == 0? selfName : referenceNames[ref]);
+            s->segSnr = segmentalSnr(reference, output, length, sampleRate);
+            s->lsd = logSpectralDistance(reference, refLength, output, outputLength,
+                sampleRate);
+            if(refFile != NULL) {
+                closeMappedWaveFile(refFile);
+            }
+            printf("%-8s %5s %-8s %8.2f %8.2f %8.1f %8.1f\n", clipName, speedNames[speed],
+                s->referenceName, s->segSnr, s->lsd, cpuTime*1.0e3,
+                cpuTime*1.0e9/outputLength);
+        }
+        if(selfOutput != output) {
+            free(selfOutput);
+        }
+        free(output);
+    }
+    closeMappedWaveFile(inFile);
+    return numScores;
+}
+
+// Find the baseline score for the same case, or NULL if there is none.
+static score *findScore(
+    score *scores,
+    int numScores,
+    score *s)
+{
+    int i;
+
+    for(i = 0; i < numScores; i++) {
+        if(!strcmp(scores[i].clipName, s->clipName) &&
+                !strcmp(scores[i].speedName, s->speedName) &&
+                !strcmp(scores[i].referenceName, s->referenceName)) {
+            return scores + i;
+        }
+    }
+    return NULL;
+}
+
+// Read "clip speed reference segSnr lsd" lines from the baseline file.  Return
+// the number of scores, or -1 if the file can't be read.
+static int readBaseline(
+    score *scores)
+{
+    char line[MAX_LINE];
+    int numScores = 0;
+    score *s;
+    FILE *file = fopen(baselineName, "r");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open baseline %s\n", baselineName);
+        return -1;
+    }
+    while(numScores < MAX_CASES && fgets(line, MAX_LINE, file) != NULL) {
+        s = scores + numScores;
+        if(line[0] != '#' && sscanf(line, "%31s %31s %31s %lf %lf", s->clipName,
+                s->speedName, s->referenceName, &s->segSnr, &s->lsd) == 5) {
+            numScores++;
+        }
+    }
+    fclose(file);
+    return numScores;
+}
+
+// Return true if the score is against our own default render.
+static bool isSelfScore(
+    score *s)
+{
+    return !strncmp(s->referenceName, "self", 4);
+}
+
+// Merge the scores into the baseline file.  With the default settings, the
+// sndadj and sonic baselines are replaced, and otherwise only the self baseline
+// for these options is, so approximations can't lower the bar for the others.
+// Return false if we can't write the file.
+static bool writeBaseline(
+    score *scores,
+    int numScores)
+{
+    score baseline[MAX_CASES], *b;
+    int numBaseline = readBaseline(baseline);
+    FILE *file;
+    int i;
+
+    if(numBaseline < 0) {
+        numBaseline = 0;
+    }
+    for(i = 0; i < numScores; i++) {
+        if(isSelfScore(scores + i) == usingDefaults()) {
+            continue;
+        }
+        b = findScore(baseline, numBaseline, scores + i);
+        if(b == NULL) {
+            if(numBaseline == MAX_CASES) {
+                fprintf(stderr, "Too many baseline scores\n");
+                return false;
+            }
+            b = baseline + numBaseline++;
+        }
+        *b = scores[i];
+    }
+    file = fopen(baselineName, "w");
+    if(file == NULL) {
+        fprintf(stderr, "Unable to write baseline %s\n", baselineName);
+        return false;
+    }
+    fprintf(file, "# clip speed reference segSnr lsd, written by sndadj_quality -s\n");
+    for(i = 0; i < numBaseline; i++) {
+        fprintf(file, "%s %s %s %.2f %.2f\n", baseline[i].clipName, baseline[i].speedName,
+            baseline[i].referenceName, baseline[i].segSnr, baseline[i].lsd);
+    }
+    return fclose(file) == 0;
+}
+
+// Compare each score with the baseline.  Return false if any got worse by more
+// than the tolerance.  The segmental SNR only counts for self scores.
+static bool checkBaseline(
+    score *scores,
+    int numScores)
+{
+    score baseline[MAX_CASES], *b;
+    int numBaseline = readBaseline(baseline);
+    int i, numFailed = 0;
+
+    if(numBaseline < 0) {
+        return false;
+    }
+    for(i = 0; i < numScores; i++) {
+        b = findScore(baseline, numBaseline, scores + i);
+        if(b == NULL && !isSelfScore(scores + i)) {
+            printf("FAILED %s %s %s: no baseline\n", scores[i].clipName,
+                scores[i].speedName, scores[i].referenceName);
+            numFailed++;
+        } else if(b == NULL) {
+            printf("No baseline for %s %s %s\n", scores[i].clipName, scores[i].speedName,
+                scores[i].referenceName);
+        } else if(scores[i].lsd > b->lsd + LSD_TOLERANCE || (isSelfScore(scores + i) &&
+                scores[i].segSnr < b->segSnr - SEG_SNR_TOLERANCE)) {
+            printf("FAILED %s %s %s: segSnr %.2f (baseline %.2f), lsd %.2f (baseline %.2f)\n",
+                scores[i].clipName, scores[i].speedName, scores[i].referenceName,
+                scores[i].segSnr, b->segSnr, scores[i].lsd, b->lsd);
+            numFailed++;
+        }
+    }
+    if(numFailed == 0) {
+        printf("All %d scores are within tolerance of %s\n", numScores, baselineName);
+    }
+    return numFailed == 0;
+}
+
+// Print usage and exit.
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sndadj_quality [OPTIONS]\n"
+        "    Render the samples with reference renders, score them, and check the\n"
+        "    scores against the baseline.  Run it from the top directory.\n"
+        "    -b file   -- The baseline.  Defaults to samples/quality.txt.\n"
+        "    -s        -- Save the scores as the new baseline instead of checking.\n"
+        "                 With options, only their self baseline is saved.\n"
+        STREAM_OPTIONS_USAGE);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    score scores[MAX_CASES];
+    int numScores = 0, numClipScores, numFailed = 0, xArg = 1, clip;
+
+    initStreamOptions(&options);
+    while(xArg < argc && *(argv[xArg]) == '-') {
+        if(!strcmp(argv[xArg], "-b") && xArg + 1 < argc) {
+            baselineName = argv[++xArg];
+        } else if(!strcmp(argv[xArg], "-s")) {
+            saveBaseline = true;
+        } else if(!parseStreamOption(&options, argc, argv, &xArg)) {
+            usage();
+        }
+        xArg++;
+    }
+    if(xArg != argc) {
+        usage();
+    }
+    setSelfName();
+    printf("%-8s %5s %-8s %8s %8s %8s %8s\n", "clip", "speed", "ref", "segSnr", "lsd",
+        "cpu ms", "ns/out");
+    for(clip = 0; clip < NUM_CLIPS; clip++) {
+        numClipScores = scoreClip(clipNames[clip], scores + numScores, &numFailed);
+        if(numClipScores < 0) {
+            return 1;
+        }
+        numScores += numClipScores;
+    }
+    if(saveBaseline) {
+        return writeBaseline(scores, numScores)? 0 : 1;
+    }
+    return checkBaseline(scores, numScores) && numFailed == 0? 0 : 1;
+}
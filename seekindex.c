@@ -0,0 +1,219 @@
+/*
+This file supports building, reading and writing seek index files.  All values
+are little endian.  The header is:
+
+    00 - "SNDSEEKS"
+    08 - version (32 bits, currently 1)
+    12 - sample rate (32 bits)
+    16 - number of channels (32 bits)
+    20 - number of seek points (32 bits)
+
+Each seek point is then:
+
+    input frame (64 bits)
+    period (16 bits)
+    voiced (16 bits, 1 if voiced, else 0)
+
+The points are in order of input frame, so we can binary search them.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sndadj.h"
+#include "seekindex.h"
+
+#define SEEK_INDEX_VERSION 1
+#define SEEK_INDEX_HEADER_SIZE 24
+#define SEEK_POINT_SIZE 12
+
+struct seekIndexStruct {
+    int sampleRate;
+    int numChannels;
+    sndadjSeekPoint *points;
+    int numPoints, pointsSize;
+};
+
+/* Store a value as length bytes in little endian order. */
+static void putValue(
+    unsigned char *bytes,
+    long long value,
+    int length)
+{
+    int i;
+
+    for(i = 0; i < length; i++) {
+        bytes[i] = value;
+        value >>= 8;
+    }
+}
+
+/* Get a little endian value of length bytes. */
+static long long getValue(
+    unsigned char *bytes,
+    int length)
+{
+    long long value = 0;
+    int i;
+
+    for(i = length - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+/* Create an empty seek index. */
+seekIndex createSeekIndex(
+    int sampleRate,
+    int numChannels)
+{
+    seekIndex index = (seekIndex)calloc(1, sizeof(struct seekIndexStruct));
+
+    if(index == NULL) {
+        return NULL;
+    }
+    index->sampleRate = sampleRate;
+    index->numChannels = numChannels;
+    return index;
+}
+
+/* Free the seek index. */
+void destroySeekIndex(
+    seekIndex index)
+{
+    if(index->points != NULL) {
+        free(index->points);
+    }
+    free(index);
+}
+
+/* Add a seek point to the end of the index.  Return 0 if out of memory. */
+int addSeekPoint(
+    seekIndex index,
+    const sndadjSeekPoint *point)
+{
+    sndadjSeekPoint *points;
+    int pointsSize;
+
+    if(index->numPoints == index->pointsSize) {
+        pointsSize = index->pointsSize == 0? 1024 : index->pointsSize*2;
+        points = (sndadjSeekPoint *)realloc(index->points,
+            pointsSize*sizeof(sndadjSeekPoint));
+        if(points == NULL) {
+            return 0;
+        }
+        index->points = points;
+        index->pointsSize = pointsSize;
+    }
+    index->points[index->numPoints++] = *point;
+    return 1;
+}
+
+/* Return the last seek point at or before inputPos, or NULL if inputPos is
+   before the first one. */
+const sndadjSeekPoint *findSeekPoint(
+    seekIndex index,
+    long long inputPos)
+{
+    int low = 0, high = index->numPoints, middle;
+
+    while(low < high) {
+        middle = (low + high) >> 1;
+        if(index->points[middle].inputPos <= inputPos) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low == 0? NULL : index->points + low - 1;
+}
+
+/* Read a whole seek index file. */
+seekIndex readSeekIndex(
+    char *fileName,
+    int *sampleRate,
+    int *numChannels)
+{
+    unsigned char header[SEEK_INDEX_HEADER_SIZE], bytes[SEEK_POINT_SIZE];
+    sndadjSeekPoint point;
+    seekIndex index;
+    int numPoints, i;
+    FILE *file = fopen(fileName, "rb");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open seek index %s for reading\n", fileName);
+        return NULL;
+    }
+    if(fread(header, 1, SEEK_INDEX_HEADER_SIZE, file) != SEEK_INDEX_HEADER_SIZE ||
+            memcmp(header, "SNDSEEKS", 8) || getValue(header + 8, 4) != SEEK_INDEX_VERSION) {
+        fprintf(stderr, "%s is not a seek index\n", fileName);
+        fclose(file);
+        return NULL;
+    }
+    index = createSeekIndex(getValue(header + 12, 4), getValue(header + 16, 4));
+    if(index == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    numPoints = getValue(header + 20, 4);
+    for(i = 0; i < numPoints; i++) {
+        if(fread(bytes, 1, SEEK_POINT_SIZE, file) != SEEK_POINT_SIZE) {
+            fprintf(stderr, "Seek index %s is truncated\n", fileName);
+            break;
+        }
+        point.inputPos = getValue(bytes, 8);
+        point.period = getValue(bytes + 8, 2);
+        point.voiced = getValue(bytes + 10, 2) != 0;
+        if(!addSeekPoint(index, &point)) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+    }
+    fclose(file);
+    if(i < numPoints) {
+        destroySeekIndex(index);
+        return NULL;
+    }
+    *sampleRate = index->sampleRate;
+    *numChannels = index->numChannels;
+    return index;
+}
+
+/* Write the seek index to a file.  Return 0 if the file could not be written. */
+int writeSeekIndex(
+    seekIndex index,
+    char *fileName)
+{
+    unsigned char header[SEEK_INDEX_HEADER_SIZE], bytes[SEEK_POINT_SIZE];
+    sndadjSeekPoint *point;
+    int passed = 1, i;
+    FILE *file = fopen(fileName, "wb");
+
+    if(file == NULL) {
+        fprintf(stderr, "Unable to open seek index %s for writing\n", fileName);
+        return 0;
+    }
+    memcpy(header, "SNDSEEKS", 8);
+    putValue(header + 8, SEEK_INDEX_VERSION, 4);
+    putValue(header + 12, index->sampleRate, 4);
+    putValue(header + 16, index->numChannels, 4);
+    putValue(header + 20, index->numPoints, 4);
+    if(fwrite(header, 1, SEEK_INDEX_HEADER_SIZE, file) != SEEK_INDEX_HEADER_SIZE) {
+        passed = 0;
+    }
+    for(i = 0; passed && i < index->numPoints; i++) {
+        point = index->points + i;
+        putValue(bytes, point->inputPos, 8);
+        putValue(bytes + 8, point->period, 2);
+        putValue(bytes + 10, point->voiced, 2);
+        if(fwrite(bytes, 1, SEEK_POINT_SIZE, file) != SEEK_POINT_SIZE) {
+            passed = 0;
+        }
+    }
+    if(fclose(file) != 0) {
+        passed = 0;
+    }
+    if(!passed) {
+        fprintf(stderr, "Unable to write seek index %s\n", fileName);
+    }
+    return passed;
+}
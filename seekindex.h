@@ -0,0 +1,12 @@
+/* Support for building, saving and searching seek indexes.  A seek index holds
+   the seek point sndadj reports at each step of a clip, so a player can restart
+   a stream anywhere in the clip without analyzing everything before it. */
+
+typedef struct seekIndexStruct *seekIndex;
+
+seekIndex createSeekIndex(int sampleRate, int numChannels);
+seekIndex readSeekIndex(char *fileName, int *sampleRate, int *numChannels);
+int writeSeekIndex(seekIndex index, char *fileName);
+void destroySeekIndex(seekIndex index);
+int addSeekPoint(seekIndex index, const sndadjSeekPoint *point);
+const sndadjSeekPoint *findSeekPoint(seekIndex index, long long inputPos);
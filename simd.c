@@ -0,0 +1,954 @@
+/*
+Vectorized inner loops.  The x86 kernels are compiled with target attributes so
+the rest of the program does not need -mavx2, and are only called if the CPU
+reports support for them.  NEON is selected at compile time, since the compiler
+only defines __ARM_NEON when the target is guaranteed to have it.
+*/
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// The vector kernels accumulate 16-bit differences in 32-bit lanes.  A block of
+// BLOCK_SIZE samples adds at most BLOCK_SIZE/4 differences of up to 65535 to
+// any one lane, which fits in 31 bits, so we flush the lanes to a 64-bit total
+// once per block.
+#define BLOCK_SIZE 32768
+// The bounded kernels compare the total with the limit after every BOUND_BLOCK
+// samples.  Lanes hold less than 2^20 after a block, so the block's total fits
+// in 32 bits.
+#define BOUND_BLOCK 64
+
+// The reference version.
+long long sumAbsDiffScalar(
+    short *a,
+    short *b,
+    int length)
+{
+    long long diff = 0;
+    short aVal, bVal;
+    int i;
+
+    for(i = 0; i < length; i++) {
+        aVal = *a++;
+        bVal = *b++;
+        diff += aVal >= bVal? aVal - bVal : bVal - aVal;
+    }
+    return diff;
+}
+
+// The reference version of the bounded kernel.
+long long sumAbsDiffBoundedScalar(
+    short *a,
+    short *b,
+    int length,
+    long long limit)
+{
+    long long diff = 0;
+    int i = 0;
+
+    while(i + BOUND_BLOCK <= length) {
+        diff += sumAbsDiffScalar(a + i, b + i, BOUND_BLOCK);
+        i += BOUND_BLOCK;
+        if(diff > limit) {
+            return diff;
+        }
+    }
+    return diff + sumAbsDiffScalar(a + i, b + i, length - i);
+}
+
+// The reference version of the sliding kernel.
+long long slideAbsDiffScalar(
+    short *samples,
+    int period,
+    int length)
+{
+    long long diff = 0;
+    int in, out, i;
+
+    for(i = 0; i < length; i++) {
+        in = samples[i] - samples[i + period];
+        out = samples[i - period] - samples[i];
+        diff += (in >= 0? in : -in) - (out >= 0? out : -out);
+    }
+    return diff;
+}
+
+// The reference version of the cross-fade.  lrint rounds to nearest even, the
+// same as the vector conversions in the default rounding mode.
+void crossFadeScalar(
+    short *out,
+    int stride,
+    const double *a,
+    const double *b,
+    double ratio,
+    double ratioStep,
+    int length)
+{
+    double r;
+    long value;
+    int i;
+
+    for(i = 0; i < length; i++) {
+        r = ratio + i*ratioStep;
+        value = lrint((1.0 - r)*a[i] + r*b[i]);
+        *out = value > SHRT_MAX? SHRT_MAX : value < SHRT_MIN? SHRT_MIN : value;
+        out += stride;
+    }
+}
+
+// The reference version of the fixed point cross-fade.
+void crossFadeFixedScalar(
+    short *out,
+    int stride,
+    const short *a,
+    const short *b,
+    int ratio,
+    int ratioStep,
+    int length)
+{
+    int r, i;
+
+    for(i = 0; i < length; i++) {
+        r = (ratio + i*ratioStep) >> 15;
+        *out = (((1 << 15) - r)*a[i] + r*b[i] + (1 << 14)) >> 15;
+        out += stride;
+    }
+}
+
+// The reference version of the period mix.
+void mixPeriodsScalar(
+    double *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const double *ratios,
+    int length)
+{
+    int i;
+
+    for(i = 0; i < length; i++) {
+        out[i] = ratios[i]*(*a) + (1.0 - ratios[i])*(*b);
+        a += stride;
+        b += stride;
+    }
+}
+
+// The reference version of the fixed point period mix.
+void mixPeriodsFixedScalar(
+    short *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const short *ratios,
+    int length)
+{
+    int i;
+
+    for(i = 0; i < length; i++) {
+        out[i] = (ratios[i]*(*a) + ((1 << 15) - ratios[i])*(*b) + (1 << 14)) >> 15;
+        a += stride;
+        b += stride;
+    }
+}
+
+#ifdef SIMD_X86
+
+// |a - b| of signed shorts, computed as max - min so it cannot overflow.  The
+// result is an unsigned 16-bit value, which we widen to 32 bits by unpacking
+// with zeros.
+__attribute__((target("sse2")))
+static long long sumAbsDiffSse2(
+    short *a,
+    short *b,
+    int length)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc, x, y, d;
+    int lanes[4];
+    long long diff = 0;
+    int i = 0, blockEnd;
+
+    while(i + 8 <= length) {
+        acc = _mm_setzero_si128();
+        blockEnd = i + BLOCK_SIZE < length? i + BLOCK_SIZE : length;
+        for(; i + 8 <= blockEnd; i += 8) {
+            x = _mm_loadu_si128((__m128i *)(a + i));
+            y = _mm_loadu_si128((__m128i *)(b + i));
+            d = _mm_sub_epi16(_mm_max_epi16(x, y), _mm_min_epi16(x, y));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(d, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(d, zero));
+        }
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        diff += (long long)(unsigned)lanes[0] + (unsigned)lanes[1] +
+            (unsigned)lanes[2] + (unsigned)lanes[3];
+    }
+    return diff + sumAbsDiffScalar(a + i, b + i, length - i);
+}
+
+// Same as the SSE2 version, 16 samples at a time.
+__attribute__((target("avx2")))
+static long long sumAbsDiffAvx2(
+    short *a,
+    short *b,
+    int length)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc, x, y, d;
+    __m128i half;
+    int lanes[4];
+    long long diff = 0;
+    int i = 0, blockEnd;
+
+    while(i + 16 <= length) {
+        acc = _mm256_setzero_si256();
+        blockEnd = i + BLOCK_SIZE < length? i + BLOCK_SIZE : length;
+        for(; i + 16 <= blockEnd; i += 16) {
+            x = _mm256_loadu_si256((__m256i *)(a + i));
+            y = _mm256_loadu_si256((__m256i *)(b + i));
+            d = _mm256_sub_epi16(_mm256_max_epi16(x, y), _mm256_min_epi16(x, y));
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(d, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(d, zero));
+        }
+        // Lanes hold at most 2^31 here, so adding the two halves can't wrap
+        // past 32 unsigned bits.
+        half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        _mm_storeu_si128((__m128i *)lanes, half);
+        diff += (long long)(unsigned)lanes[0] + (unsigned)lanes[1] +
+            (unsigned)lanes[2] + (unsigned)lanes[3];
+    }
+    // The SSE2 kernel is not VEX encoded, so clear the upper halves first, or
+    // every SSE instruction in it pays for the transition out of AVX state.
+    _mm256_zeroupper();
+    return diff + sumAbsDiffSse2(a + i, b + i, length - i);
+}
+
+// The SSE2 and NEON bounded kernels just call the plain ones a block at a time.
+__attribute__((target("sse2")))
+static long long sumAbsDiffBoundedSse2(
+    short *a,
+    short *b,
+    int length,
+    long long limit)
+{
+    long long diff = 0;
+    int i = 0;
+
+    while(i + BOUND_BLOCK <= length) {
+        diff += sumAbsDiffSse2(a + i, b + i, BOUND_BLOCK);
+        i += BOUND_BLOCK;
+        if(diff > limit) {
+            return diff;
+        }
+    }
+    return diff + sumAbsDiffSse2(a + i, b + i, length - i);
+}
+
+// The AVX2 bounded kernel adds each block of 64 samples with straight line code,
+// in two accumulators, since a loop this short costs as much as the arithmetic.
+__attribute__((target("avx2")))
+static long long sumAbsDiffBoundedAvx2(
+    short *a,
+    short *b,
+    int length,
+    long long limit)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc0, acc1, d0, d1, d2, d3;
+    __m128i half;
+    long long diff = 0;
+    int i = 0;
+
+    while(i + BOUND_BLOCK <= length) {
+        d0 = _mm256_loadu_si256((__m256i *)(a + i));
+        d1 = _mm256_loadu_si256((__m256i *)(b + i));
+        d2 = _mm256_loadu_si256((__m256i *)(a + i + 16));
+        d3 = _mm256_loadu_si256((__m256i *)(b + i + 16));
+        d0 = _mm256_sub_epi16(_mm256_max_epi16(d0, d1), _mm256_min_epi16(d0, d1));
+        d2 = _mm256_sub_epi16(_mm256_max_epi16(d2, d3), _mm256_min_epi16(d2, d3));
+        acc0 = _mm256_add_epi32(_mm256_unpacklo_epi16(d0, zero),
+            _mm256_unpackhi_epi16(d0, zero));
+        acc1 = _mm256_add_epi32(_mm256_unpacklo_epi16(d2, zero),
+            _mm256_unpackhi_epi16(d2, zero));
+        d0 = _mm256_loadu_si256((__m256i *)(a + i + 32));
+        d1 = _mm256_loadu_si256((__m256i *)(b + i + 32));
+        d2 = _mm256_loadu_si256((__m256i *)(a + i + 48));
+        d3 = _mm256_loadu_si256((__m256i *)(b + i + 48));
+        d0 = _mm256_sub_epi16(_mm256_max_epi16(d0, d1), _mm256_min_epi16(d0, d1));
+        d2 = _mm256_sub_epi16(_mm256_max_epi16(d2, d3), _mm256_min_epi16(d2, d3));
+        acc0 = _mm256_add_epi32(acc0, _mm256_add_epi32(_mm256_unpacklo_epi16(d0, zero),
+            _mm256_unpackhi_epi16(d0, zero)));
+        acc1 = _mm256_add_epi32(acc1, _mm256_add_epi32(_mm256_unpacklo_epi16(d2, zero),
+            _mm256_unpackhi_epi16(d2, zero)));
+        acc0 = _mm256_add_epi32(acc0, acc1);
+        half = _mm_add_epi32(_mm256_castsi256_si128(acc0),
+            _mm256_extracti128_si256(acc0, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        diff += _mm_cvtsi128_si32(half);
+        i += BOUND_BLOCK;
+        if(diff > limit) {
+            _mm256_zeroupper();
+            return diff;
+        }
+    }
+    _mm256_zeroupper();
+    return diff + sumAbsDiffSse2(a + i, b + i, length - i);
+}
+
+// The sliding kernel subtracts the differences that leave the window from the
+// ones that enter it lane by lane.  Each lane changes by less than 2^17 per
+// vector, so 32-bit lanes are safe for any length below 2^17.
+__attribute__((target("avx2")))
+static long long slideAbsDiffAvx2(
+    short *samples,
+    int period,
+    int length)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    __m256i x, y, z, in, out;
+    __m128i half;
+    int i;
+
+    for(i = 0; i + 16 <= length; i += 16) {
+        x = _mm256_loadu_si256((__m256i *)(samples + i - period));
+        y = _mm256_loadu_si256((__m256i *)(samples + i));
+        z = _mm256_loadu_si256((__m256i *)(samples + i + period));
+        in = _mm256_sub_epi16(_mm256_max_epi16(y, z), _mm256_min_epi16(y, z));
+        out = _mm256_sub_epi16(_mm256_max_epi16(x, y), _mm256_min_epi16(x, y));
+        acc = _mm256_add_epi32(acc, _mm256_sub_epi32(_mm256_unpacklo_epi16(in, zero),
+            _mm256_unpacklo_epi16(out, zero)));
+        acc = _mm256_add_epi32(acc, _mm256_sub_epi32(_mm256_unpackhi_epi16(in, zero),
+            _mm256_unpackhi_epi16(out, zero)));
+    }
+    half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    _mm256_zeroupper();
+    return _mm_cvtsi128_si32(half) + slideAbsDiffScalar(samples + i, period, length - i);
+}
+
+// Same as the AVX2 version, 8 samples at a time.
+__attribute__((target("sse2")))
+static long long slideAbsDiffSse2(
+    short *samples,
+    int period,
+    int length)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    __m128i x, y, z, in, out;
+    int i;
+
+    for(i = 0; i + 8 <= length; i += 8) {
+        x = _mm_loadu_si128((__m128i *)(samples + i - period));
+        y = _mm_loadu_si128((__m128i *)(samples + i));
+        z = _mm_loadu_si128((__m128i *)(samples + i + period));
+        in = _mm_sub_epi16(_mm_max_epi16(y, z), _mm_min_epi16(y, z));
+        out = _mm_sub_epi16(_mm_max_epi16(x, y), _mm_min_epi16(x, y));
+        acc = _mm_add_epi32(acc, _mm_sub_epi32(_mm_unpacklo_epi16(in, zero),
+            _mm_unpacklo_epi16(out, zero)));
+        acc = _mm_add_epi32(acc, _mm_sub_epi32(_mm_unpackhi_epi16(in, zero),
+            _mm_unpackhi_epi16(out, zero)));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc) + slideAbsDiffScalar(samples + i, period, length - i);
+}
+
+// The cross-fades do the same operations in the same order as the scalar
+// version, so their results are identical.  packs saturates to 16 bits.  This
+// does samples start to length - 1, two at a time, and then the last odd one
+// on its own, rather than with lrint, which is a library call unless math
+// errors are turned off.
+__attribute__((target("sse2"), always_inline))
+static inline void crossFadePairs(
+    short *out,
+    int stride,
+    const double *a,
+    const double *b,
+    double ratio,
+    double ratioStep,
+    int start,
+    int length)
+{
+    __m128d index = _mm_set_pd(start + 1.0, start);
+    __m128d two = _mm_set1_pd(2.0);
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d first = _mm_set1_pd(ratio);
+    __m128d step = _mm_set1_pd(ratioStep);
+    __m128d r, value;
+    __m128i packed;
+    int i, pair;
+
+    for(i = start; i + 2 <= length; i += 2) {
+        r = _mm_add_pd(first, _mm_mul_pd(index, step));
+        value = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(one, r), _mm_loadu_pd(a + i)),
+            _mm_mul_pd(r, _mm_loadu_pd(b + i)));
+        packed = _mm_cvtpd_epi32(value);
+        pair = _mm_cvtsi128_si32(_mm_packs_epi32(packed, packed));
+        out[i*stride] = (short)pair;
+        out[(i + 1)*stride] = (short)(pair >> 16);
+        index = _mm_add_pd(index, two);
+    }
+    if(i < length) {
+        r = _mm_add_sd(first, _mm_mul_sd(index, step));
+        value = _mm_add_sd(_mm_mul_sd(_mm_sub_sd(one, r), _mm_load_sd(a + i)),
+            _mm_mul_sd(r, _mm_load_sd(b + i)));
+        packed = _mm_cvtsi32_si128(_mm_cvtsd_si32(value));
+        out[i*stride] = (short)_mm_cvtsi128_si32(_mm_packs_epi32(packed, packed));
+    }
+}
+
+__attribute__((target("sse2")))
+static void crossFadeSse2(
+    short *out,
+    int stride,
+    const double *a,
+    const double *b,
+    double ratio,
+    double ratioStep,
+    int length)
+{
+    crossFadePairs(out, stride, a, b, ratio, ratioStep, 0, length);
+}
+
+// Same as the SSE2 version, 4 samples at a time.  With one channel the output
+// is contiguous, and otherwise we scatter the lanes.
+__attribute__((target("avx2")))
+static void crossFadeAvx2(
+    short *out,
+    int stride,
+    const double *a,
+    const double *b,
+    double ratio,
+    double ratioStep,
+    int length)
+{
+    __m256d index = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+    __m256d four = _mm256_set1_pd(4.0);
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d first = _mm256_set1_pd(ratio);
+    __m256d step = _mm256_set1_pd(ratioStep);
+    __m256d r, value;
+    __m128i packed;
+    short lanes[8];
+    int i, j;
+
+    for(i = 0; i + 4 <= length; i += 4) {
+        r = _mm256_add_pd(first, _mm256_mul_pd(index, step));
+        value = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(one, r), _mm256_loadu_pd(a + i)),
+            _mm256_mul_pd(r, _mm256_loadu_pd(b + i)));
+        packed = _mm256_cvtpd_epi32(value);
+        packed = _mm_packs_epi32(packed, packed);
+        if(stride == 1) {
+            _mm_storel_epi64((__m128i *)(out + i), packed);
+        } else {
+            _mm_storeu_si128((__m128i *)lanes, packed);
+            for(j = 0; j < 4; j++) {
+                out[(i + j)*stride] = lanes[j];
+            }
+        }
+        index = _mm256_add_pd(index, four);
+    }
+    // Inlined here, the pairs are VEX encoded, so there is no AVX to SSE
+    // transition until we return.
+    crossFadePairs(out, stride, a, b, ratio, ratioStep, i, length);
+    _mm256_zeroupper();
+}
+
+// Load two samples stride apart and widen them to doubles.
+__attribute__((target("sse2"), always_inline))
+static inline __m128d loadPair(
+    const short *a,
+    int stride)
+{
+    return _mm_cvtepi32_pd(_mm_set_epi32(0, 0, a[stride], a[0]));
+}
+
+// Mix samples start to length - 1 two at a time, and then the last odd one.
+// The products and sum are the same as in the scalar version, so the results
+// are identical.
+__attribute__((target("sse2"), always_inline))
+static inline void mixPeriodPairs(
+    double *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const double *ratios,
+    int start,
+    int length)
+{
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d r;
+    int i;
+
+    for(i = start; i + 2 <= length; i += 2) {
+        r = _mm_loadu_pd(ratios + i);
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(r, loadPair(a + i*stride, stride)),
+            _mm_mul_pd(_mm_sub_pd(one, r), loadPair(b + i*stride, stride))));
+    }
+    if(i < length) {
+        out[i] = ratios[i]*a[i*stride] + (1.0 - ratios[i])*b[i*stride];
+    }
+}
+
+__attribute__((target("sse2")))
+static void mixPeriodsSse2(
+    double *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const double *ratios,
+    int length)
+{
+    mixPeriodPairs(out, a, b, stride, ratios, 0, length);
+}
+
+// Load four samples stride apart and widen them to doubles.  With one channel
+// they are contiguous, and one 64-bit load gets them all.
+__attribute__((target("avx2"), always_inline))
+static inline __m256d loadQuad(
+    const short *a,
+    int stride)
+{
+    __m128i x;
+
+    if(stride == 1) {
+        x = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)a));
+    } else {
+        x = _mm_set_epi32(a[3*stride], a[2*stride], a[stride], a[0]);
+    }
+    return _mm256_cvtepi32_pd(x);
+}
+
+// Same as the SSE2 version, 4 samples at a time.
+__attribute__((target("avx2")))
+static void mixPeriodsAvx2(
+    double *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const double *ratios,
+    int length)
+{
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d r;
+    int i;
+
+    for(i = 0; i + 4 <= length; i += 4) {
+        r = _mm256_loadu_pd(ratios + i);
+        _mm256_storeu_pd(out + i, _mm256_add_pd(
+            _mm256_mul_pd(r, loadQuad(a + i*stride, stride)),
+            _mm256_mul_pd(_mm256_sub_pd(one, r), loadQuad(b + i*stride, stride))));
+    }
+    mixPeriodPairs(out, a, b, stride, ratios, i, length);
+    _mm256_zeroupper();
+}
+
+// Load eight samples stride apart.  With one channel they are contiguous.
+__attribute__((target("sse2"), always_inline))
+static inline __m128i loadOctet(
+    const short *a,
+    int stride)
+{
+    if(stride == 1) {
+        return _mm_loadu_si128((const __m128i *)a);
+    }
+    return _mm_set_epi16(a[7*stride], a[6*stride], a[5*stride], a[4*stride],
+        a[3*stride], a[2*stride], a[stride], a[0]);
+}
+
+// The fixed point mixes madd the pairs (a, b) and (r, -r), which gives
+// r*(a - b), and add b << 15, which makes r*a + (32768 - r)*b, exactly as the
+// scalar version computes it.  r is at most 32767, so -r fits in 16 bits, and
+// the products in 32.  The result always fits in a short, so packs never
+// saturates.
+__attribute__((target("sse2")))
+static void mixPeriodsFixedSse2(
+    short *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const short *ratios,
+    int length)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i round = _mm_set1_epi32(1 << 14);
+    __m128i x, y, r, negR, lo, hi;
+    int i;
+
+    for(i = 0; i + 8 <= length; i += 8) {
+        x = loadOctet(a + i*stride, stride);
+        y = loadOctet(b + i*stride, stride);
+        r = _mm_loadu_si128((const __m128i *)(ratios + i));
+        negR = _mm_sub_epi16(zero, r);
+        lo = _mm_madd_epi16(_mm_unpacklo_epi16(x, y), _mm_unpacklo_epi16(r, negR));
+        hi = _mm_madd_epi16(_mm_unpackhi_epi16(x, y), _mm_unpackhi_epi16(r, negR));
+        lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(zero, y), 1));
+        hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(zero, y), 1));
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 15);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 15);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+    }
+    mixPeriodsFixedScalar(out + i, a + i*stride, b + i*stride, stride, ratios + i,
+        length - i);
+}
+
+// Same as the SSE2 version, 16 samples at a time.  The unpacks and packs work
+// within each 128-bit half, so the samples come out in order.
+__attribute__((target("avx2")))
+static void mixPeriodsFixedAvx2(
+    short *out,
+    const short *a,
+    const short *b,
+    int stride,
+    const short *ratios,
+    int length)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i round = _mm256_set1_epi32(1 << 14);
+    __m256i x, y, r, negR, lo, hi;
+    int i;
+
+    for(i = 0; i + 16 <= length; i += 16) {
+        if(stride == 1) {
+            x = _mm256_loadu_si256((const __m256i *)(a + i));
+            y = _mm256_loadu_si256((const __m256i *)(b + i));
+        } else {
+            x = _mm256_inserti128_si256(_mm256_castsi128_si256(loadOctet(a + i*stride,
+                stride)), loadOctet(a + (i + 8)*stride, stride), 1);
+            y = _mm256_inserti128_si256(_mm256_castsi128_si256(loadOctet(b + i*stride,
+                stride)), loadOctet(b + (i + 8)*stride, stride), 1);
+        }
+        r = _mm256_loadu_si256((const __m256i *)(ratios + i));
+        negR = _mm256_sub_epi16(zero, r);
+        lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(x, y), _mm256_unpacklo_epi16(r, negR));
+        hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(x, y), _mm256_unpackhi_epi16(r, negR));
+        lo = _mm256_add_epi32(lo, _mm256_srai_epi32(_mm256_unpacklo_epi16(zero, y), 1));
+        hi = _mm256_add_epi32(hi, _mm256_srai_epi32(_mm256_unpackhi_epi16(zero, y), 1));
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), 15);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), 15);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_packs_epi32(lo, hi));
+    }
+    _mm256_zeroupper();
+    mixPeriodsFixedSse2(out + i, a + i*stride, b + i*stride, stride, ratios + i,
+        length - i);
+}
+
+// The fixed point cross-fades work out eight Q30 ratios at a time in 32-bit
+// lanes, and then mix as the fixed point period mixes do, with the weight on b:
+// madd of (b, a) and (r, -r), plus a << 15.  The results are identical to the
+// scalar version.  The ratios stay below 1 << 30 for all length samples, so
+// with at least a vector's worth, the multiples of ratioStep we set up fit in
+// an int.
+__attribute__((target("sse2")))
+static void crossFadeFixedSse2(
+    short *out,
+    int stride,
+    const short *a,
+    const short *b,
+    int ratio,
+    int ratioStep,
+    int length)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i round = _mm_set1_epi32(1 << 14);
+    __m128i step, first, second, x, y, r, negR, lo, hi;
+    short lanes[8];
+    int i, j;
+
+    if(length < 8) {
+        crossFadeFixedScalar(out, stride, a, b, ratio, ratioStep, length);
+        return;
+    }
+    step = _mm_set1_epi32(8*ratioStep);
+    first = _mm_add_epi32(_mm_set1_epi32(ratio),
+        _mm_set_epi32(3*ratioStep, 2*ratioStep, ratioStep, 0));
+    second = _mm_add_epi32(first, _mm_set1_epi32(4*ratioStep));
+    for(i = 0; i + 8 <= length; i += 8) {
+        x = _mm_loadu_si128((const __m128i *)(a + i));
+        y = _mm_loadu_si128((const __m128i *)(b + i));
+        r = _mm_packs_epi32(_mm_srai_epi32(first, 15), _mm_srai_epi32(second, 15));
+        negR = _mm_sub_epi16(zero, r);
+        lo = _mm_madd_epi16(_mm_unpacklo_epi16(y, x), _mm_unpacklo_epi16(r, negR));
+        hi = _mm_madd_epi16(_mm_unpackhi_epi16(y, x), _mm_unpackhi_epi16(r, negR));
+        lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(zero, x), 1));
+        hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(zero, x), 1));
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 15);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 15);
+        if(stride == 1) {
+            _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+        } else {
+            _mm_storeu_si128((__m128i *)lanes, _mm_packs_epi32(lo, hi));
+            for(j = 0; j < 8; j++) {
+                out[(i + j)*stride] = lanes[j];
+            }
+        }
+        first = _mm_add_epi32(first, step);
+        second = _mm_add_epi32(second, step);
+    }
+    crossFadeFixedScalar(out + i*stride, stride, a + i, b + i, ratio + i*ratioStep,
+        ratioStep, length - i);
+}
+
+// Same as the SSE2 version, 16 samples at a time.  Packing the ratios works
+// within each 128-bit half, so we put the 64-bit quarters back in order.
+__attribute__((target("avx2")))
+static void crossFadeFixedAvx2(
+    short *out,
+    int stride,
+    const short *a,
+    const short *b,
+    int ratio,
+    int ratioStep,
+    int length)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i round = _mm256_set1_epi32(1 << 14);
+    __m256i step, first, second, x, y, r, negR, lo, hi;
+    short lanes[16];
+    int i, j;
+
+    if(length < 16) {
+        crossFadeFixedSse2(out, stride, a, b, ratio, ratioStep, length);
+        return;
+    }
+    step = _mm256_set1_epi32(16*ratioStep);
+    first = _mm256_add_epi32(_mm256_set1_epi32(ratio),
+        _mm256_set_epi32(7*ratioStep, 6*ratioStep, 5*ratioStep, 4*ratioStep,
+        3*ratioStep, 2*ratioStep, ratioStep, 0));
+    second = _mm256_add_epi32(first, _mm256_set1_epi32(8*ratioStep));
+    for(i = 0; i + 16 <= length; i += 16) {
+        x = _mm256_loadu_si256((const __m256i *)(a + i));
+        y = _mm256_loadu_si256((const __m256i *)(b + i));
+        r = _mm256_packs_epi32(_mm256_srai_epi32(first, 15), _mm256_srai_epi32(second, 15));
+        r = _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0));
+        negR = _mm256_sub_epi16(zero, r);
+        lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, x), _mm256_unpacklo_epi16(r, negR));
+        hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, x), _mm256_unpackhi_epi16(r, negR));
+        lo = _mm256_add_epi32(lo, _mm256_srai_epi32(_mm256_unpacklo_epi16(zero, x), 1));
+        hi = _mm256_add_epi32(hi, _mm256_srai_epi32(_mm256_unpackhi_epi16(zero, x), 1));
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), 15);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), 15);
+        if(stride == 1) {
+            _mm256_storeu_si256((__m256i *)(out + i), _mm256_packs_epi32(lo, hi));
+        } else {
+            _mm256_storeu_si256((__m256i *)lanes, _mm256_packs_epi32(lo, hi));
+            for(j = 0; j < 16; j++) {
+                out[(i + j)*stride] = lanes[j];
+            }
+        }
+        first = _mm256_add_epi32(first, step);
+        second = _mm256_add_epi32(second, step);
+    }
+    _mm256_zeroupper();
+    crossFadeFixedSse2(out + i*stride, stride, a + i, b + i, ratio + i*ratioStep,
+        ratioStep, length - i);
+}
+
+#endif
+
+#ifdef SIMD_NEON
+
+// vabal widens |a - b| to 32 bits as it accumulates, so it cannot overflow.
+static long long sumAbsDiffNeon(
+    short *a,
+    short *b,
+    int length)
+{
+    int32x4_t acc;
+    int16x8_t x, y;
+    long long diff = 0;
+    int i = 0, blockEnd;
+
+    while(i + 8 <= length) {
+        acc = vdupq_n_s32(0);
+        blockEnd = i + BLOCK_SIZE < length? i + BLOCK_SIZE : length;
+        for(; i + 8 <= blockEnd; i += 8) {
+            x = vld1q_s16(a + i);
+            y = vld1q_s16(b + i);
+            acc = vabal_s16(acc, vget_low_s16(x), vget_low_s16(y));
+            acc = vabal_s16(acc, vget_high_s16(x), vget_high_s16(y));
+        }
+        diff += (long long)(unsigned)vgetq_lane_s32(acc, 0) +
+            (unsigned)vgetq_lane_s32(acc, 1) + (unsigned)vgetq_lane_s32(acc, 2) +
+            (unsigned)vgetq_lane_s32(acc, 3);
+    }
+    return diff + sumAbsDiffScalar(a + i, b + i, length - i);
+}
+
+static long long sumAbsDiffBoundedNeon(
+    short *a,
+    short *b,
+    int length,
+    long long limit)
+{
+    long long diff = 0;
+    int i = 0;
+
+    while(i + BOUND_BLOCK <= length) {
+        diff += sumAbsDiffNeon(a + i, b + i, BOUND_BLOCK);
+        i += BOUND_BLOCK;
+        if(diff > limit) {
+            return diff;
+        }
+    }
+    return diff + sumAbsDiffNeon(a + i, b + i, length - i);
+}
+
+// vabdq gives |a - b|, which fits in an unsigned 16-bit value, and the widening
+// subtract takes the outgoing differences from the incoming ones.
+static long long slideAbsDiffNeon(
+    short *samples,
+    int period,
+    int length)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    uint16x8_t in, out;
+    int16x8_t x, y, z;
+    int i;
+
+    for(i = 0; i + 8 <= length; i += 8) {
+        x = vld1q_s16(samples + i - period);
+        y = vld1q_s16(samples + i);
+        z = vld1q_s16(samples + i + period);
+        in = vreinterpretq_u16_s16(vabdq_s16(y, z));
+        out = vreinterpretq_u16_s16(vabdq_s16(x, y));
+        acc = vaddq_s32(acc, vreinterpretq_s32_u32(vsubl_u16(vget_low_u16(in),
+            vget_low_u16(out))));
+        acc = vaddq_s32(acc, vreinterpretq_s32_u32(vsubl_u16(vget_high_u16(in),
+            vget_high_u16(out))));
+    }
+    return (long long)vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) +
+        vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3) +
+        slideAbsDiffScalar(samples + i, period, length - i);
+}
+
+#endif
+
+// Return the fastest sumAbsDiff kernel this CPU supports.
+sumAbsDiffFunc selectSumAbsDiff(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return sumAbsDiffAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return sumAbsDiffSse2;
+    }
+#elif defined(SIMD_NEON)
+    return sumAbsDiffNeon;
+#endif
+    return sumAbsDiffScalar;
+}
+
+// Return the fastest bounded sumAbsDiff kernel this CPU supports.
+sumAbsDiffBoundedFunc selectSumAbsDiffBounded(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return sumAbsDiffBoundedAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return sumAbsDiffBoundedSse2;
+    }
+#elif defined(SIMD_NEON)
+    return sumAbsDiffBoundedNeon;
+#endif
+    return sumAbsDiffBoundedScalar;
+}
+
+// Return the fastest sliding kernel this CPU supports.
+slideAbsDiffFunc selectSlideAbsDiff(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return slideAbsDiffAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return slideAbsDiffSse2;
+    }
+#elif defined(SIMD_NEON)
+    return slideAbsDiffNeon;
+#endif
+    return slideAbsDiffScalar;
+}
+
+// Return the fastest cross-fade this CPU supports.  NEON only has double
+// precision vectors on 64-bit ARM, where two lanes gain little over the scalar
+// loop, so ARM uses the scalar version.
+crossFadeFunc selectCrossFade(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return crossFadeAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return crossFadeSse2;
+    }
+#endif
+    return crossFadeScalar;
+}
+
+// Return the fastest fixed point cross-fade this CPU supports.  There is no NEON
+// version yet, so ARM uses the scalar one.
+crossFadeFixedFunc selectCrossFadeFixed(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return crossFadeFixedAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return crossFadeFixedSse2;
+    }
+#endif
+    return crossFadeFixedScalar;
+}
+
+// Return the fastest period mix this CPU supports.  ARM uses the scalar version
+// for the same reason as the cross-fade.
+mixPeriodsFunc selectMixPeriods(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return mixPeriodsAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return mixPeriodsSse2;
+    }
+#endif
+    return mixPeriodsScalar;
+}
+
+// Return the fastest fixed point period mix this CPU supports.  There is no NEON
+// version yet, so ARM uses the scalar one.
+mixPeriodsFixedFunc selectMixPeriodsFixed(void)
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return mixPeriodsFixedAvx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return mixPeriodsFixedSse2;
+    }
+#endif
+    return mixPeriodsFixedScalar;
+}
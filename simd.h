@@ -0,0 +1,75 @@
+/*
+Vectorized inner loops, selected at run time by CPU feature detection.  Each
+kernel has a plain C version which is the reference for the others.
+*/
+
+// Return the sum of |a[i] - b[i]| for i from 0 to length - 1.
+typedef long long (*sumAbsDiffFunc)(short *a, short *b, int length);
+
+long long sumAbsDiffScalar(short *a, short *b, int length);
+// Return the fastest sumAbsDiff kernel this CPU supports.
+sumAbsDiffFunc selectSumAbsDiff(void);
+
+// The same sum, but the kernel may stop early and return a partial sum once it
+// is more than limit.  The result is the full sum if that is no more than
+// limit, and more than limit otherwise.
+typedef long long (*sumAbsDiffBoundedFunc)(short *a, short *b, int length,
+    long long limit);
+
+long long sumAbsDiffBoundedScalar(short *a, short *b, int length, long long limit);
+// Return the fastest bounded sumAbsDiff kernel this CPU supports.
+sumAbsDiffBoundedFunc selectSumAbsDiffBounded(void);
+
+// Return how much the sum of |samples[i - period] - samples[i]| over a window
+// of period samples changes when the window slides forward by length samples.
+// That is the sum of |samples[i] - samples[i + period]| minus the sum of
+// |samples[i - period] - samples[i]|, for i from 0 to length - 1.
+typedef long long (*slideAbsDiffFunc)(short *samples, int period, int length);
+
+long long slideAbsDiffScalar(short *samples, int period, int length);
+// Return the fastest sliding kernel this CPU supports.
+slideAbsDiffFunc selectSlideAbsDiff(void);
+
+// Cross-fade from a to b, and write the results rounded and saturated to 16
+// bits to out[i*stride], for i from 0 to length - 1.  The weight of b is ratio
+// + i*ratioStep.
+typedef void (*crossFadeFunc)(short *out, int stride, const double *a, const double *b,
+    double ratio, double ratioStep, int length);
+
+void crossFadeScalar(short *out, int stride, const double *a, const double *b,
+    double ratio, double ratioStep, int length);
+// Return the fastest cross-fade this CPU supports.
+crossFadeFunc selectCrossFade(void);
+
+// The same cross-fade in fixed point.  ratio and ratioStep are in Q30, and the
+// Q15 weight of b, r = (ratio + i*ratioStep) >> 15, must stay below 1 << 15:
+// out[i*stride] = ((32768 - r)*a[i] + r*b[i] + 16384) >> 15.
+typedef void (*crossFadeFixedFunc)(short *out, int stride, const short *a, const short *b,
+    int ratio, int ratioStep, int length);
+
+void crossFadeFixedScalar(short *out, int stride, const short *a, const short *b,
+    int ratio, int ratioStep, int length);
+// Return the fastest fixed point cross-fade this CPU supports.
+crossFadeFixedFunc selectCrossFadeFixed(void);
+
+// Mix two periods of 16-bit samples, stride apart, into doubles:
+// out[i] = ratios[i]*a[i*stride] + (1 - ratios[i])*b[i*stride].  The ratios
+// may be in out.
+typedef void (*mixPeriodsFunc)(double *out, const short *a, const short *b, int stride,
+    const double *ratios, int length);
+
+void mixPeriodsScalar(double *out, const short *a, const short *b, int stride,
+    const double *ratios, int length);
+// Return the fastest period mix this CPU supports.
+mixPeriodsFunc selectMixPeriods(void);
+
+// The same mix in fixed point, with Q15 ratios from 0 to 32767, rounded:
+// out[i] = (ratios[i]*a[i*stride] + (32768 - ratios[i])*b[i*stride] + 16384) >> 15.
+// The ratios may be in out.
+typedef void (*mixPeriodsFixedFunc)(short *out, const short *a, const short *b, int stride,
+    const short *ratios, int length);
+
+void mixPeriodsFixedScalar(short *out, const short *a, const short *b, int stride,
+    const short *ratios, int length);
+// Return the fastest fixed point period mix this CPU supports.
+mixPeriodsFixedFunc selectMixPeriodsFixed(void);
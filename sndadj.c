@@ -14,211 +14,2299 @@ crossed by the playback point
 
 A reasonble heuristic may be to take a step size that is half the period.  This
 guarantees decent overlap.
+
+By default the step is the period.  sndadjSetStepScale makes it a fraction or a
+multiple of the period instead.  Multiples skip some of the input, but at high
+speeds playback skips most of each step anyway.
 */
 
 #include <stdio.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <math.h>
-#include "wave.h"
+#include <stdatomic.h>
+#include "sndadj.h"
+#include "simd.h"
+#include "fft.h"
+#ifdef SNDADJ_PROFILE
+#include <time.h>
+#endif
 
 #define MIN_FREQ 65
 #define MAX_FREQ 135
-static int minPeriod, maxPeriod;
-static double speed;
-static int inputPos = 0, outputPos = 0;
-static double exactInputPos = 0.0;
-static short *inputSamples, *outputSamples;
-static int inputLength, outputLength;
-static int period, prevPeriod, stepSize;
-static double *filter, *prevFilter;
-static int filterPos = 0, prevFilterPos = 0;
-static int sampleRate, numChannels;
-static bool prevPeriodVoiced = false;
+// sndadjProcessBuffer writes the input this many frames at a time, so the
+// stream only buffers a little of it.
+#define PROCESS_CHUNK 4096
+
+// One playback speed.  The filters are shared by every speed, but each speed
+// plays through them at its own rate, into its own output buffer.
+struct playbackStruct {
+    double speed;
+    double targetSpeed; // Speed is ramped to this by speedDelta per output sample
+    double speedDelta;
+    double exactInputPos; // Absolute playback position in the input
+    int filterPos, prevFilterPos;
+    short *outputSamples; // Interleaved numChannels samples per frame
+    int outputLength, outputSize; // Counted in frames
+    bool externalOutput; // outputSamples is the caller's, and can't be grown
+};
+
+typedef struct playbackStruct *playback;
+
+// How much of a filter has been computed.  Filters are only built as far as
+// playback reads them, which is a run of samples starting where playback first
+// enters the filter, wrapping around at the period.  At high speeds, most of
+// each filter is never read, so it is never computed.
+struct filterStateStruct {
+    long long center; // Absolute input position the filter is built around
+    int builtStart; // First sample computed
+    int builtLength; // Samples computed from builtStart on, wrapping at the period
+};
+
+struct sndadjStreamStruct {
+    int minPeriod, maxPeriod;
+    struct playbackStruct *playbacks;
+    int numSpeeds, speedsSize;
+    double speedRamp; // Seconds of output over which speed changes are ramped
+    double stepScale; // Periods per step, or 0 to pick from the speed
+    bool started; // Set once we have played a step since the last reset
+    int inputPos;
+    long long inputOffset; // Absolute position of inputSamples[0] in the input
+    short *inputSamples; // Interleaved numChannels samples per frame
+    short *pitchSamples; // Mono down-mix of the input, or inputSamples if mono
+    int inputLength, inputSize; // Counted in frames
+    int period, prevPeriod, stepSize;
+    double *filter, *prevFilter; // Planar: channel c starts at c*maxPeriod
+    short *fixedFilter, *fixedPrevFilter; // Only the filters of the mode are allocated
+    struct filterStateStruct filterState, prevFilterState;
+    struct rampTableStruct *rampTable; // Shared by every stream with these periods
+    bool fixedPoint;
+    bool analysisOnly; // Compute filters but don't play them
+    sndadjLoopCallback loopCallback;
+    void *loopUserData;
+    short *loopSamples; // The filter rounded to shorts for the loop callback
+    int sampleRate, numChannels;
+    bool prevPeriodVoiced;
+    sndadjTraceCallback traceCallback;
+    void *traceUserData;
+    sndadjSeekCallback seekCallback;
+    void *seekUserData;
+    bool seekPending; // Rebuild the filter at inputPos before the next step
+#ifdef SNDADJ_PROFILE
+    sndadjProfile profile;
+    long long profileStart;
+#endif
+    sumAbsDiffFunc sumAbsDiff;
+    sumAbsDiffBoundedFunc sumAbsDiffBounded;
+    slideAbsDiffFunc slideAbsDiff;
+    crossFadeFunc crossFade;
+    crossFadeFixedFunc crossFadeFixed;
+    mixPeriodsFunc mixPeriods;
+    mixPeriodsFixedFunc mixPeriodsFixed;
+    int decimation; // Factor the coarse pitch search down-samples by
+    bool prunedSearch; // Abandon losing AMDF candidates early
+    bool skipUnvoiced; // Don't search for a period in silence or noise
+    short *downSampleBuffer;
+    sndadjPitchEngine pitchEngine;
+    fftPlan yinPlan; // The rest are only allocated for the YIN engine
+    double *fftReal, *fftImag;
+    double *yinEnergy; // Running sum of squares over the analysis segment
+    double *yinDiff;
+    long long *lagSums; // Only allocated for the sliding engine
+    long long *lagPositions; // Absolute position each lag's sum is for, or -1
+};
+
+// The pruned AMDF search sums every VOICING_STRIDE'th period in full, to
+// estimate the average difference for the voicing decision.
+#define VOICING_STRIDE 16
+// With skipUnvoiced, a step is taken as silent if the average magnitude around
+// it is below SILENCE_LEVEL, and as unvoiced if the signal crosses zero more
+// than UNVOICED_CROSSINGS times a second, which voiced speech hardly ever does.
+#define SILENCE_LEVEL 64
+#define UNVOICED_CROSSINGS 3000
+// Steps are from MIN_STEP_SCALE to MAX_STEP_SCALE periods long, though never so
+// short that a playback could pass over one in a single output sample.
+#define MIN_STEP_SCALE 0.25
+#define MAX_STEP_SCALE 4.0
+// An automatic step scale is at most MAX_AUTO_STEP_SCALE periods.  Longer steps
+// score worse than the quality baselines allow.
+#define MAX_AUTO_STEP_SCALE 1.5
+// In fixed point mode, speeds, speed ramps and playback positions are kept to
+// multiples of 1/(1 << FIXED_POS_BITS), so the fixed point loops can track the
+// position with an integer cursor in that many fraction bits, and still agree
+// exactly with the double bookkeeping that sizes the output buffers.
+#define FIXED_POS_BITS 16
+// When decimation is automatic, down-sample to no less than this rate.
+#define MIN_DECIMATED_RATE 8000
+// The YIN engine takes the first dip in the cumulative mean normalized
+// difference below YIN_THRESHOLD, and calls the period voiced if the difference
+// there is below YIN_VOICED_THRESHOLD.
+#define YIN_THRESHOLD 0.15
+#define YIN_VOICED_THRESHOLD 0.35
+
+// Pitch tracing costs one test of traceCallback per step, unless it is compiled
+// out entirely with -DSNDADJ_NO_TRACE.
+#ifdef SNDADJ_NO_TRACE
+#define TRACE_PITCH(stream, samples, period, minDiff, aveDiff, voiced) do {} while(0)
+#else
+#define TRACE_PITCH(stream, samples, period, minDiff, aveDiff, voiced) \
+    do { \
+        if((stream)->traceCallback != NULL) { \
+            tracePitch(stream, samples, period, minDiff, aveDiff, voiced); \
+        } \
+    } while(0)
+#endif
+
+// Profiling reads the clock around each stage of a step, which is cheap next to
+// the stages themselves, but is only compiled in with -DSNDADJ_PROFILE.
+#ifdef SNDADJ_PROFILE
+#define PROFILE_START(stream) ((stream)->profileStart = getNanoseconds())
+#define PROFILE_STOP(stream, field) \
+    ((stream)->profile.field += getNanoseconds() - (stream)->profileStart)
+
+// Return nanoseconds on a monotonic clock.
+static long long getNanoseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+#else
+#define PROFILE_START(stream)
+#define PROFILE_STOP(stream, field)
+#endif
 
 #define min(a, b) ((a) <= (b)? (a) : (b))
 #define max(a, b) ((a) >= (b)? (a) : (b))
 
-// Find the best frequency match.  This routine looks for a pitch period just
-// prior to the samples pointer which matches one just after it, so samples
-// should be valid for at least maxPeriod samples as a negative index, as
-// well as a positive index.
-static int findPitchPeriod(
-    short *samples)
+// Search periods from start to stop for the one with the smallest average
+// magnitude difference between the period just before samples and the period
+// just after.  Return the best period, and set *minDiffPtr to its average
+// difference per sample, and *aveDiffPtr to the average of that over all the
+// periods searched.
+static int searchPeriods(
+    sndadjStream stream,
+    short *samples,
+    int start,
+    int stop,
+    long long *minDiffPtr,
+    long long *aveDiffPtr)
 {
     int period, bestPeriod = 0;
-    short *s, *p, sVal, pVal;
     long long diff, minDiff = 1;
-    long long totalDiff = 0, aveDiff;
-    int i, start, stop;
+    long long totalDiff = 0;
 
-    if(prevPeriodVoiced) {
-        start = max(minPeriod, (prevPeriod*2)/3);
-        stop = min(maxPeriod, (prevPeriod*3)/2);
-    } else {
-        start = minPeriod;
-        stop = maxPeriod;
-    }
     for(period = start; period <= stop; period++) {
-	diff = 0;
-	s = samples - period;
-	p = samples;
-	for(i = 0; i < period; i++) {
-	    sVal = *s++;
-	    pVal = *p++;
-	    diff += sVal >= pVal? sVal - pVal : pVal - sVal;
-	}
+	diff = stream->sumAbsDiff(samples - period, samples, period);
         totalDiff += diff/period;
 	if(diff*bestPeriod < minDiff*period) {
 	    minDiff = diff;
 	    bestPeriod = period;
 	}
     }
-    aveDiff = totalDiff/(stop - start);
-    printf("Period %d, minDiff %lld, aveDiff %lld", bestPeriod,
-        minDiff/bestPeriod, aveDiff);
-    prevPeriodVoiced = minDiff/bestPeriod <= aveDiff/2 && aveDiff > 100;
-    if(prevPeriodVoiced) {
-        printf(", voiced\n");
-    } else {
-        printf("\n");
+    *minDiffPtr = minDiff/bestPeriod;
+    *aveDiffPtr = stop > start? totalDiff/(stop - start) : totalDiff;
+    return bestPeriod;
+}
+
+// Search the same periods as searchPeriods, and find the same best period, but
+// visit them in order of distance from center, which is where the last period
+// was, so a good match is found early and most other candidates are abandoned
+// after a block or two.  Ties go to the shorter period, as in searchPeriods.
+// The average difference is estimated from every VOICING_STRIDE'th period.
+static int searchPeriodsPruned(
+    sndadjStream stream,
+    short *samples,
+    int start,
+    int stop,
+    int center,
+    long long *minDiffPtr,
+    long long *aveDiffPtr)
+{
+    int period, distance, side, bestPeriod = 0;
+    long long diff, limit, minDiff = 1;
+    long long totalDiff = 0;
+    int numSampled = 0;
+
+    center = max(start, min(stop, center));
+    for(distance = 0; distance <= stop - start; distance++) {
+        for(side = 0; side < 2; side++) {
+            period = side == 0? center + distance : center - distance;
+            if(period < start || period > stop || (side == 1 && distance == 0)) {
+                continue;
+            }
+            if((period - start) % VOICING_STRIDE == 0) {
+                diff = stream->sumAbsDiff(samples - period, samples, period);
+                totalDiff += diff/period;
+                numSampled++;
+            } else {
+                // A candidate whose sum passes the limit has a larger
+                // normalized difference than the best, so the kernel can stop
+                // early, and the partial sum it returns still loses.
+                limit = bestPeriod == 0? LLONG_MAX : minDiff*period/bestPeriod;
+                diff = stream->sumAbsDiffBounded(samples - period, samples, period, limit);
+            }
+            if(diff*bestPeriod < minDiff*period ||
+                    (diff*bestPeriod == minDiff*period && period < bestPeriod)) {
+                minDiff = diff;
+                bestPeriod = period;
+            }
+        }
     }
+    *minDiffPtr = minDiff/bestPeriod;
+    *aveDiffPtr = totalDiff/numSampled;
     return bestPeriod;
 }
 
-// Compute the filter at the next filter point, one step in the future from
-// inputPos.
-static void computeFilter(
+// Run the full or the pruned AMDF search.
+static int searchAmdf(
+    sndadjStream stream,
+    short *samples,
+    int start,
+    int stop,
+    int center,
+    long long *minDiffPtr,
+    long long *aveDiffPtr)
+{
+    if(stream->prunedSearch) {
+        return searchPeriodsPruned(stream, samples, start, stop, center, minDiffPtr,
+            aveDiffPtr);
+    }
+    return searchPeriods(stream, samples, start, stop, minDiffPtr, aveDiffPtr);
+}
+
+// Search the same periods as searchPeriods, with the same result, but keep each
+// period's sum of differences from one search to the next.  The sum for a
+// period ends at samples, so when samples moves forward by a few samples we add
+// the differences that slid in and subtract the ones that slid out, rather than
+// summing the whole period again.  That only pays when the move is less than
+// half the period, and the samples the old window started at are still in the
+// input buffer.
+static int searchPeriodsSliding(
+    sndadjStream stream,
+    short *samples,
+    int start,
+    int stop,
+    long long *minDiffPtr,
+    long long *aveDiffPtr)
+{
+    long long position = stream->inputOffset + (samples - stream->pitchSamples);
+    long long diff, minDiff = 1;
+    long long totalDiff = 0;
+    int period, bestPeriod = 0;
+    int move;
+
+    for(period = start; period <= stop; period++) {
+        // Unused sums are at -1, which fails the test for being in the buffer.
+        move = 0;
+        if(stream->lagPositions[period] - period >= stream->inputOffset) {
+            move = position - stream->lagPositions[period];
+        }
+        if(move > 0 && 2*move < period) {
+            diff = stream->lagSums[period] + stream->slideAbsDiff(samples - move, period,
+                move);
+        } else {
+            diff = stream->sumAbsDiff(samples - period, samples, period);
+        }
+        stream->lagSums[period] = diff;
+        stream->lagPositions[period] = position;
+        totalDiff += diff/period;
+        if(diff*bestPeriod < minDiff*period) {
+            minDiff = diff;
+            bestPeriod = period;
+        }
+    }
+    *minDiffPtr = minDiff/bestPeriod;
+    *aveDiffPtr = stop > start? totalDiff/(stop - start) : totalDiff;
+    return bestPeriod;
+}
+
+// Forget the sliding engine's sums, since the input they were computed from is
+// gone.
+static void clearLagSums(
+    sndadjStream stream)
+{
+    int period;
+
+    if(stream->lagPositions == NULL) {
+        return;
+    }
+    for(period = 0; period <= stream->maxPeriod; period++) {
+        stream->lagPositions[period] = -1;
+    }
+}
+
+// Average each group of decimation samples from maxPeriod before samples to
+// maxPeriod after into downSampleBuffer.  Return a pointer to the down-sampled
+// value corresponding to samples.
+static short *downSample(
+    sndadjStream stream,
+    short *samples)
+{
+    int skip = stream->decimation;
+    int numCoarse = stream->maxPeriod/skip;
+    short *s = samples - numCoarse*skip;
+    short *d = stream->downSampleBuffer;
+    int i, j, value;
+
+    for(i = 0; i < 2*numCoarse; i++) {
+        value = 0;
+        for(j = 0; j < skip; j++) {
+            value += *s++;
+        }
+        *d++ = value/skip;
+    }
+    return stream->downSampleBuffer + numCoarse;
+}
+
+// Search periods from start to stop using YIN's cumulative mean normalized
+// difference.  For each lag, the squared difference between the maxPeriod
+// samples before samples and the same window shifted by the lag is
+//
+//     d(lag) = E(0, maxPeriod) + E(lag, lag + maxPeriod) - 2*r(lag)
+//
+// where E is the energy over a range of the segment, and r is the
+// autocorrelation of the window with the segment, which we compute for all lags
+// at once with one FFT of size >= 2*maxPeriod.  The window goes in the real
+// part and the whole segment in the imaginary part, so one forward transform
+// gives us both spectra.  minDiff and aveDiff are reported as RMS differences
+// per sample, so they are on the same scale as the AMDF's.
+static int searchPeriodsYin(
+    sndadjStream stream,
+    short *samples,
+    int start,
+    int stop,
+    long long *minDiffPtr,
+    long long *aveDiffPtr,
+    bool *voicedPtr)
+{
+    int maxPeriod = stream->maxPeriod;
+    int size = getFFTSize(stream->yinPlan);
+    double *real = stream->fftReal, *imag = stream->fftImag;
+    double *energy = stream->yinEnergy, *diff = stream->yinDiff;
+    short *x = samples - maxPeriod;
+    double zr, zi, mr, mi, ar, ai, br, bi, d, sum, totalDiff;
+    int i, m, period, bestPeriod;
+
+    energy[0] = 0.0;
+    for(i = 0; i < size; i++) {
+        real[i] = i < maxPeriod? x[i] : 0.0;
+        imag[i] = i < 2*maxPeriod? x[i] : 0.0;
+        if(i < 2*maxPeriod) {
+            energy[i + 1] = energy[i] + (double)x[i]*x[i];
+        }
+    }
+    computeFFT(stream->yinPlan, real, imag, false);
+    for(i = 0; i <= size/2; i++) {
+        m = (size - i) & (size - 1);
+        zr = real[i]; zi = imag[i];
+        mr = real[m]; mi = imag[m];
+        // Split out the window's spectrum A and the segment's spectrum B, and
+        // replace both bins with conj(A)*B.
+        ar = (zr + mr)/2.0; ai = (zi - mi)/2.0;
+        br = (zi + mi)/2.0; bi = (mr - zr)/2.0;
+        real[i] = ar*br + ai*bi;
+        imag[i] = ar*bi - ai*br;
+        real[m] = real[i];
+        imag[m] = -imag[i];
+    }
+    computeFFT(stream->yinPlan, real, imag, true);
+    // Now real[lag] = r(lag).  Replace it with d(lag), and put the normalized
+    // difference in diff.
+    sum = 0.0;
+    diff[0] = 1.0;
+    for(period = 1; period <= stop; period++) {
+        d = energy[maxPeriod] + energy[period + maxPeriod] - energy[period] -
+            2.0*real[period];
+        if(d < 0.0) {
+            d = 0.0; // Rounding error
+        }
+        real[period] = d;
+        sum += d;
+        diff[period] = sum > 0.0? d*period/sum : 1.0;
+    }
+    bestPeriod = start;
+    for(period = start; period <= stop; period++) {
+        if(diff[period] < YIN_THRESHOLD) {
+            while(period < stop && diff[period + 1] < diff[period]) {
+                period++;
+            }
+            bestPeriod = period;
+            break;
+        }
+        if(diff[period] < diff[bestPeriod]) {
+            bestPeriod = period;
+        }
+    }
+    totalDiff = 0.0;
+    for(period = start; period <= stop; period++) {
+        totalDiff += sqrt(real[period]/maxPeriod);
+    }
+    *minDiffPtr = sqrt(real[bestPeriod]/maxPeriod);
+    *aveDiffPtr = totalDiff/(stop - start + 1);
+    *voicedPtr = diff[bestPeriod] < YIN_VOICED_THRESHOLD && *aveDiffPtr > 100;
+    return bestPeriod;
+}
+
+#ifndef SNDADJ_NO_TRACE
+// Report the result of a pitch search to the trace callback.
+static void tracePitch(
+    sndadjStream stream,
     short *samples,
+    int period,
+    long long minDiff,
+    long long aveDiff,
+    bool voiced)
+{
+    sndadjPitchTrace trace;
+
+    trace.inputPos = stream->inputOffset + (samples - stream->pitchSamples) -
+        stream->maxPeriod;
+    trace.period = period;
+    trace.minDiff = minDiff;
+    trace.aveDiff = aveDiff;
+    trace.voiced = voiced;
+    stream->traceCallback(stream->traceUserData, &trace);
+}
+#endif
+
+// Return true if the maxPeriod samples either side of samples are silent or
+// unvoiced, so there is no pitch to find there.  This only looks at each sample
+// once, which is far cheaper than any pitch search.
+static bool isUnvoiced(
+    sndadjStream stream,
+    short *samples)
+{
+    int length = 2*stream->maxPeriod;
+    short *x = samples - stream->maxPeriod;
+    long long level = 0;
+    int i, crossings = 0;
+    bool positive = x[0] >= 0;
+
+    for(i = 0; i < length; i++) {
+        level += x[i] >= 0? x[i] : -x[i];
+        if((x[i] >= 0) != positive) {
+            positive = !positive;
+            crossings++;
+        }
+    }
+    return level < (long long)SILENCE_LEVEL*length ||
+        (long long)crossings*stream->sampleRate > (long long)UNVOICED_CROSSINGS*length;
+}
+
+// Find the best frequency match.  This routine looks for a pitch period just
+// prior to the samples pointer which matches one just after it, so samples
+// should be valid for at least maxPeriod samples as a negative index, as
+// well as a positive index.  If decimation is on, we first search a
+// down-sampled copy of the signal, and then refine the result at the full
+// sample rate in a small window around the coarse match.  The voicing decision
+// is made from the coarse search in that case.  The YIN engine always searches
+// at the full rate, since its cost hardly depends on the number of periods, and
+// so does the sliding engine, since its sums are for the full rate signal.  If
+// skipUnvoiced is set, silent and unvoiced steps skip the search, and keep the
+// last period, so steps go on at a fixed size until the voice comes back.
+static int findPitchPeriod(
+    sndadjStream stream,
+    short *samples)
+{
+    int bestPeriod, skip = stream->decimation;
+    long long minDiff, aveDiff, fineMinDiff, fineAveDiff;
+    int start, stop;
+    bool voiced = false;
+
+    if(stream->skipUnvoiced && isUnvoiced(stream, samples)) {
+        TRACE_PITCH(stream, samples, stream->period, 0, 0, false);
+        stream->prevPeriodVoiced = false;
+        return stream->period;
+    }
+
+    if(stream->prevPeriodVoiced) {
+        start = max(stream->minPeriod, (stream->prevPeriod*2)/3);
+        stop = min(stream->maxPeriod, (stream->prevPeriod*3)/2);
+    } else {
+        start = stream->minPeriod;
+        stop = stream->maxPeriod;
+    }
+    if(stream->pitchEngine == SNDADJ_PITCH_YIN) {
+        bestPeriod = searchPeriodsYin(stream, samples, start, stop, &minDiff,
+            &aveDiff, &voiced);
+    } else if(stream->pitchEngine == SNDADJ_PITCH_SLIDING) {
+        bestPeriod = searchPeriodsSliding(stream, samples, start, stop, &minDiff,
+            &aveDiff);
+    } else if(skip == 1) {
+        bestPeriod = searchAmdf(stream, samples, start, stop, stream->prevPeriod,
+            &minDiff, &aveDiff);
+    } else {
+        bestPeriod = skip*searchAmdf(stream, downSample(stream, samples),
+            max(start/skip, 1), stop/skip, stream->prevPeriod/skip, &minDiff, &aveDiff);
+        bestPeriod = searchAmdf(stream, samples, max(start, bestPeriod - 2*skip),
+            min(stop, bestPeriod + 2*skip), bestPeriod, &fineMinDiff, &fineAveDiff);
+    }
+    if(stream->pitchEngine != SNDADJ_PITCH_YIN) {
+        voiced = minDiff <= aveDiff/2 && aveDiff > 100;
+    }
+    TRACE_PITCH(stream, samples, bestPeriod, minDiff, aveDiff, voiced);
+    stream->prevPeriodVoiced = voiced;
+    return bestPeriod;
+}
+
+// The cross-fade ratios i/period of each period up to maxPeriod, in doubles,
+// and in Q15 for fixed point.  They only depend on the period, so one table
+// serves every stream whose periods it covers.  The ratios of a period are
+// computed the first time any stream uses it, and are never changed or freed
+// after that, so streams share them without locking.  Most filters are built
+// from the handful of periods around the speaker's pitch, so few are computed,
+// and at most a table takes 1.8MB of doubles and 0.46MB of Q15 at 44100 Hz,
+// once per program rather than once per stream.
+struct rampTableStruct {
+    int maxPeriod;
+    _Atomic(double *) *ramps; // ramps[period][i] is i/period, or NULL until used
+    _Atomic(short *) *fixedRamps;
+    struct rampTableStruct *next;
+};
+
+typedef struct rampTableStruct *rampTable;
+
+// Every ramp table made so far, newest first.  Tables are only ever added.
+static _Atomic(rampTable) rampTables;
+
+// Return the first table in the list which covers maxPeriod, or NULL if there
+// is none.
+static rampTable findRampTable(
+    rampTable table,
+    int maxPeriod)
+{
+    while(table != NULL && table->maxPeriod < maxPeriod) {
+        table = table->next;
+    }
+    return table;
+}
+
+// Free a ramp table which was never added to the list.
+static void freeRampTable(
+    rampTable table)
+{
+    if(table->ramps != NULL) {
+        free(table->ramps);
+    }
+    if(table->fixedRamps != NULL) {
+        free(table->fixedRamps);
+    }
+    free(table);
+}
+
+// Return a ramp table covering maxPeriod, making it if there isn't one yet.  If
+// another stream adds one first while we make ours, we use theirs and free
+// ours.  Return NULL if out of memory.
+static rampTable getRampTable(
+    int maxPeriod)
+{
+    rampTable table = findRampTable(atomic_load(&rampTables), maxPeriod);
+    rampTable found;
+
+    if(table != NULL) {
+        return table;
+    }
+    table = (rampTable)calloc(1, sizeof(struct rampTableStruct));
+    if(table == NULL) {
+        return NULL;
+    }
+    table->maxPeriod = maxPeriod;
+    table->ramps = (_Atomic(double *) *)calloc(maxPeriod + 1, sizeof(_Atomic(double *)));
+    table->fixedRamps = (_Atomic(short *) *)calloc(maxPeriod + 1, sizeof(_Atomic(short *)));
+    if(table->ramps == NULL || table->fixedRamps == NULL) {
+        freeRampTable(table);
+        return NULL;
+    }
+    table->next = atomic_load(&rampTables);
+    // On failure, the exchange sets table->next to the new head of the list.
+    while(!atomic_compare_exchange_weak(&rampTables, &table->next, table)) {
+        found = findRampTable(table->next, maxPeriod);
+        if(found != NULL) {
+            freeRampTable(table);
+            return found;
+        }
+    }
+    return table;
+}
+
+// Return the cross-fade ratios i/period for a filter of this period, computing
+// them if no stream has used the period yet.  If another stream stores them
+// first, we use theirs.  Return NULL if out of memory.
+static double *getRamp(
+    sndadjStream stream,
     int period)
 {
-    double *f = filter;
-    short *p = samples - period;
-    short *q = samples;
+    _Atomic(double *) *slot = stream->rampTable->ramps + period;
+    double *ramp = atomic_load(slot);
+    double *stored = NULL;
     int i;
-    double ratio;
 
-    for(i = 0; i < period; i++) {
-        ratio = i/(double)period;
-        *f++ = (ratio)*(*p++) + (1.0 - ratio)*(*q++);
+    if(ramp == NULL) {
+        ramp = (double *)malloc(period*sizeof(double));
+        if(ramp == NULL) {
+            return NULL;
+        }
+        for(i = 0; i < period; i++) {
+            ramp[i] = i/(double)period;
+        }
+        if(!atomic_compare_exchange_strong(slot, &stored, ramp)) {
+            free(ramp);
+            ramp = stored;
+        }
+    }
+    return ramp;
+}
+
+// Return the Q15 ratios (i << 15)/period for a filter of this period, the same
+// way, or NULL if out of memory.
+static short *getFixedRamp(
+    sndadjStream stream,
+    int period)
+{
+    _Atomic(short *) *slot = stream->rampTable->fixedRamps + period;
+    short *ramp = atomic_load(slot);
+    short *stored = NULL;
+    int i;
+
+    if(ramp == NULL) {
+        ramp = (short *)malloc(period*sizeof(short));
+        if(ramp == NULL) {
+            return NULL;
+        }
+        for(i = 0; i < period; i++) {
+            ramp[i] = (i << 15)/period;
+        }
+        if(!atomic_compare_exchange_strong(slot, &stored, ramp)) {
+            free(ramp);
+            ramp = stored;
+        }
+    }
+    return ramp;
+}
+
+// Compute samples start to end - 1 of the filter centered on samples, by
+// cross-fading the period before samples into the period after it.  Each
+// channel gets its own filter, built from the same period.  With the ratios
+// shared, this is one pass of the mix kernel over the input.
+static void computeFilter(
+    sndadjStream stream,
+    double *filter,
+    short *samples,
+    int period,
+    int start,
+    int end)
+{
+    int numChannels = stream->numChannels;
+    double *ramp = getRamp(stream, period);
+    double *f;
+    int i, channel;
+
+    for(channel = 0; channel < numChannels; channel++) {
+        f = filter + channel*stream->maxPeriod + start;
+        if(ramp == NULL) {
+            // Out of memory for the ratios, so put them in the filter, and mix
+            // in place.
+            for(i = start; i < end; i++) {
+                f[i - start] = i/(double)period;
+            }
+        }
+        stream->mixPeriods(f, samples + (start - period)*numChannels + channel,
+            samples + start*numChannels + channel, numChannels,
+            ramp != NULL? ramp + start : f, end - start);
+    }
+}
+
+// Compute the filter in fixed point, with the fixed point mix kernel, the same
+// way.  The ratio is in Q15, and the two weights always add up to 1 << 15, so
+// the rounded result fits in a short.
+static void computeFilterFixed(
+    sndadjStream stream,
+    short *filter,
+    short *samples,
+    int period,
+    int start,
+    int end)
+{
+    int numChannels = stream->numChannels;
+    short *ramp = getFixedRamp(stream, period);
+    short *f;
+    int i, channel;
+
+    for(channel = 0; channel < numChannels; channel++) {
+        f = filter + channel*stream->maxPeriod + start;
+        if(ramp == NULL) {
+            for(i = start; i < end; i++) {
+                f[i - start] = (i << 15)/period;
+            }
+        }
+        stream->mixPeriodsFixed(f, samples + (start - period)*numChannels + channel,
+            samples + start*numChannels + channel, numChannels,
+            ramp != NULL? ramp + start : f, end - start);
+    }
+}
+
+// Start a new filter around the absolute input position center, without
+// computing any of it yet.
+static void startFilter(
+    sndadjStream stream,
+    long long center)
+{
+    stream->filterState.center = center;
+    stream->filterState.builtLength = 0;
+}
+
+// Mark a filter as completely computed, as it is when it has been copied in
+// whole, or is the silence the stream starts with.
+static void setFilterBuilt(
+    struct filterStateStruct *state)
+{
+    state->builtStart = 0;
+    state->builtLength = INT_MAX;
+}
+
+// Make sure count samples of the filter or previous filter from pos on,
+// wrapping at the period, have been computed.  We extend the run of samples
+// already computed to cover them, which usually just adds the samples playback
+// is about to read next.  The input the filter is built from is still in the
+// buffer, since it lies within maxPeriod of inputPos.
+static void buildFilter(
+    sndadjStream stream,
+    bool previous,
+    int pos,
+    int count)
+{
+    struct filterStateStruct *state = previous? &stream->prevFilterState :
+        &stream->filterState;
+    int period = previous? stream->prevPeriod : stream->period;
+    int offset, start, end;
+    short *samples;
+
+    if(state->builtLength >= period) {
+        return;
     }
-    // Now compute the filter position.
-    filterPos = prevFilterPos - stepSize;
+    if(state->builtLength == 0) {
+        state->builtStart = pos;
+    }
+    offset = pos - state->builtStart;
+    if(offset < 0) {
+        offset += period;
+    }
+    end = min(offset + count, period);
+    if(end <= state->builtLength) {
+        return;
+    }
+    samples = stream->inputSamples + (state->center - stream->inputOffset)*stream->numChannels;
+    start = state->builtStart + state->builtLength;
+    end += state->builtStart;
+    // The run wraps at the period, so it can take two pieces.
+    while(start < end) {
+        offset = start >= period? period : 0;
+        if(stream->fixedPoint) {
+            computeFilterFixed(stream, previous? stream->fixedPrevFilter : stream->fixedFilter,
+                samples, period, start - offset, min(end, offset + period) - offset);
+        } else {
+            computeFilter(stream, previous? stream->prevFilter : stream->filter, samples,
+                period, start - offset, min(end, offset + period) - offset);
+        }
+        start = min(end, offset + period);
+    }
+    state->builtLength = end - state->builtStart;
+}
+
+// Return an upper bound on the number of samples the playback will play in this
+// step.  During a ramp the speed only moves toward the target, so it is never
+// below the lower of the two.
+static int getStepLength(
+    sndadjStream stream,
+    playback play)
+{
+    double remaining = stream->inputOffset + stream->inputPos + stream->stepSize -
+        play->exactInputPos;
+    double speed = min(play->speed, play->targetSpeed);
+
+    return remaining > 0.0? (int)(remaining/speed) + 2 : 1;
+}
+
+// Compute the position in the new filter which lines up with the position the
+// playback has reached in the previous one.
+static void computeFilterPos(
+    sndadjStream stream,
+    playback play)
+{
+    int period = stream->period;
+    int filterPos = play->prevFilterPos - stream->stepSize;
+
     while(filterPos < 0) {
         filterPos += period;
     }
     while(filterPos >= period) {
         filterPos -= period;
     }
+    play->filterPos = filterPos;
+}
+
+// Move speed one output sample closer to the target speed.
+static double rampSpeed(
+    playback play,
+    double speed)
+{
+    speed += play->speedDelta;
+    if((play->speedDelta > 0.0) == (speed > play->targetSpeed)) {
+        speed = play->targetSpeed;
+    }
+    return speed;
+}
+
+// Round a mixed sample to the nearest short, saturating, the same way the
+// cross-fade kernels do.
+static short roundSample(
+    double value)
+{
+    long rounded = lrint(value);
+
+    return rounded > SHRT_MAX? SHRT_MAX : rounded < SHRT_MIN? SHRT_MIN : rounded;
+}
+
+// Return the number of samples a playback at a steady speed plays in this step:
+// the fewest, but at least one, that take it from exactInputPos to the end of
+// the step.  Set *endPos to the position after them.  The position is summed a
+// sample at a time, as the ramped loops do, so rounding ends each step on the
+// same sample, however it is played.
+static int getPlayLength(
+    double exactInputPos,
+    double inputPos,
+    double speed,
+    int stepSize,
+    double *endPos)
+{
+    int length = 0;
+
+    do {
+        exactInputPos += speed;
+        length++;
+    } while(exactInputPos - inputPos < stepSize);
+    *endPos = exactInputPos;
+    return length;
 }
 
-// Ramp down the previous filter while ramping up the next.
-static void playFilters()
+// Return true if the playback position is inside the step.  It is outside if
+// the playback passed over the whole step in one sample, which happens when a
+// step is shorter than the speed.
+static bool checkRatio(
+    double ratio)
+{
+    return ratio >= 0.0 && ratio <= 1.0;
+}
+
+// Ramp down the previous filter while ramping up the next, one sample at a
+// time, while the speed is being ramped.  Return false if the playback position
+// leaves the step.
+static bool playFiltersRamped(
+    sndadjStream stream,
+    playback play)
 {
     double ratio;
-    int numGenerated = 0;
+    double *prevFilter = stream->prevFilter;
+    double *filter = stream->filter;
+    int numChannels = stream->numChannels;
+    int maxPeriod = stream->maxPeriod;
+    short *out = play->outputSamples + play->outputLength*numChannels;
+    int outputLength = play->outputLength;
+    int channel;
+    int prevFilterPos = play->prevFilterPos;
+    int filterPos = play->filterPos;
+    double inputPos = (double)(stream->inputOffset + stream->inputPos);
+    int stepSize = stream->stepSize;
+    double exactInputPos = play->exactInputPos;
+    double speed = play->speed;
 
     do {
         ratio = (exactInputPos - inputPos)/stepSize;
-        if(ratio < 0.0 || ratio > 1.0) {
-            printf("Bad ratio = %f\n", ratio);
-            exit(1);
+        if(!checkRatio(ratio)) {
+            return false;
+        }
+        for(channel = 0; channel < numChannels; channel++) {
+            *out++ = roundSample((1.0 - ratio)*prevFilter[channel*maxPeriod + prevFilterPos] +
+                ratio*filter[channel*maxPeriod + filterPos]);
         }
-        outputSamples[outputPos++] = (1.0 - ratio)*prevFilter[prevFilterPos] + ratio*filter[filterPos];
-        if(++prevFilterPos == prevPeriod) {
+        outputLength++;
+        if(++prevFilterPos == stream->prevPeriod) {
             prevFilterPos = 0;
         }
-        if(++filterPos == period) {
+        if(++filterPos == stream->period) {
             filterPos = 0;
         }
-        numGenerated++;
         exactInputPos += speed;
+        if(speed != play->targetSpeed) {
+            speed = rampSpeed(play, speed);
+        }
     } while(exactInputPos - inputPos < stepSize);
-    //printf("Generated %d samples for period of %d.\n", numGenerated, period);
+    play->outputLength = outputLength;
+    play->prevFilterPos = prevFilterPos;
+    play->filterPos = filterPos;
+    play->exactInputPos = exactInputPos;
+    play->speed = speed;
+    return true;
 }
 
-// Generate samples until the current playback point has passed the next filter
-// location.  We assume we have already computed the current filter and it's
-// period, and now need to compute the step size and compute the new one.
-static void generateSamplesForOneStep(void)
+// Ramp down the previous filter while ramping up the next, at one playback
+// speed.  At a steady speed, the ratio grows by the same amount every sample,
+// so we know up front how many samples the step plays.  We play them in runs
+// that end where either filter wraps around, and cross-fade each run with the
+// vector kernel, which needs no per-sample division or wrap checks.
+static bool playFilters(
+    sndadjStream stream,
+    playback play)
 {
-    double *temp;
+    double *prevFilter = stream->prevFilter;
+    double *filter = stream->filter;
+    int numChannels = stream->numChannels;
+    int maxPeriod = stream->maxPeriod;
+    short *out = play->outputSamples + play->outputLength*numChannels;
+    int prevFilterPos = play->prevFilterPos;
+    int filterPos = play->filterPos;
+    double inputPos = (double)(stream->inputOffset + stream->inputPos);
+    int stepSize = stream->stepSize;
+    double ratio = (play->exactInputPos - inputPos)/stepSize;
+    double ratioStep = play->speed/stepSize;
+    double endPos;
+    int length, pos, run, channel;
+
+    if(play->speed != play->targetSpeed) {
+        return playFiltersRamped(stream, play);
+    }
+    if(!checkRatio(ratio)) {
+        return false;
+    }
+    length = getPlayLength(play->exactInputPos, inputPos, play->speed, stepSize, &endPos);
+    for(pos = 0; pos < length; pos += run) {
+        run = min(length - pos, min(stream->prevPeriod - prevFilterPos,
+            stream->period - filterPos));
+        for(channel = 0; channel < numChannels; channel++) {
+            stream->crossFade(out + pos*numChannels + channel, numChannels,
+                prevFilter + channel*maxPeriod + prevFilterPos,
+                filter + channel*maxPeriod + filterPos, ratio + pos*ratioStep, ratioStep, run);
+        }
+        prevFilterPos += run;
+        if(prevFilterPos == stream->prevPeriod) {
+            prevFilterPos = 0;
+        }
+        filterPos += run;
+        if(filterPos == stream->period) {
+            filterPos = 0;
+        }
+    }
+    play->outputLength += length;
+    play->prevFilterPos = prevFilterPos;
+    play->filterPos = filterPos;
+    play->exactInputPos = endPos;
+    return true;
+}
 
-    //stepSize = period/2;
-    stepSize = period;
-    prevPeriod = period;
-    temp = prevFilter;
-    prevFilter = filter;
-    filter = temp;
-    prevFilterPos = filterPos;
-    period = findPitchPeriod(inputSamples + inputPos + stepSize);
-    computeFilter(inputSamples + inputPos + stepSize, period);
-    playFilters();
-    inputPos += stepSize;
+// Return a speed or position on the fixed point grid as a Q16 integer.  It is a
+// multiple of the grid step, so this is exact.
+static long long getFixedPos(
+    double value)
+{
+    return (long long)(value*(1 << FIXED_POS_BITS));
 }
 
-// Play until out of input data.
-static void playAll(void)
+// Return the number of samples a playback at a steady speed plays in this step,
+// as getPlayLength does, from a Q16 cursor at pos to the end of the step at end.
+// Everything is on the fixed point grid, so the two always agree.
+static int getFixedPlayLength(
+    long long pos,
+    long long end,
+    int speed,
+    long long *endPos)
 {
-    inputPos = maxPeriod; // Skip initial zeros.
-    exactInputPos = maxPeriod;
-    period = minPeriod;
-    while(inputPos < inputLength) {
-        generateSamplesForOneStep();
-    }
+    int length = pos < end? (int)((end - pos + speed - 1)/speed) : 1;
+
+    *endPos = pos + (long long)length*speed;
+    return length;
 }
 
-// Read an input wave file.  This function pads the beginning and end with
-// maxPeriod zeros.
-static void readWaveFile(
-    char *fileName)
+// Ramp down the previous filter while ramping up the next, in fixed point, one
+// sample at a time, while the speed is being ramped.  The cursor and speed are
+// Q16 integers, and a multiply by the reciprocal of the step gives each Q15
+// ratio, so there is no floating point per sample.  A cursor right at the end of
+// the step counts as outside it, to keep the ratio below 1 << 15, though it
+// can't be there, as a step is longer than a playback moves in one sample.
+static bool playFiltersFixedRamped(
+    sndadjStream stream,
+    playback play)
 {
-    int inputSize = 1024 + 2*maxPeriod;
-    int samplesRead;
-    waveFile inFile = openInputWaveFile(fileName, &sampleRate, &numChannels);
+    int ratio;
+    short *prevFilter = stream->fixedPrevFilter;
+    short *filter = stream->fixedFilter;
+    int numChannels = stream->numChannels;
+    int maxPeriod = stream->maxPeriod;
+    short *out = play->outputSamples + play->outputLength*numChannels;
+    int outputLength = play->outputLength;
+    int channel;
+    int prevFilterPos = play->prevFilterPos;
+    int filterPos = play->filterPos;
+    int stepSize = stream->stepSize;
+    long long start = (stream->inputOffset + stream->inputPos) << FIXED_POS_BITS;
+    long long end = (long long)stepSize << FIXED_POS_BITS;
+    long long pos = getFixedPos(play->exactInputPos) - start;
+    long long reciprocal = (1LL << 31)/stepSize;
+    int speed = (int)getFixedPos(play->speed);
+    int targetSpeed = (int)getFixedPos(play->targetSpeed);
+    int speedDelta = (int)getFixedPos(play->speedDelta);
 
-    inputSamples = (short *)calloc(inputSize, sizeof(short));
-    inputLength = maxPeriod;
+    if(pos < 0 || pos >= end) {
+        return false;
+    }
     do {
-        samplesRead = readFromWaveFile(inFile, inputSamples + inputLength, 1024);
-        inputLength += samplesRead;
-        if(inputLength + 1024 + 2*maxPeriod >= inputSize) {
-            inputSize *= 2;
-            inputSamples = (short *)realloc(inputSamples, inputSize*sizeof(short));
-        }
-    } while(samplesRead > 0);
-    closeWaveFile(inFile);
-    memset(inputSamples + inputLength, 0, maxPeriod);
-}
-
-// Write to the output wave file.
-static void writeWaveFile(
-    char *fileName)
-{
-    waveFile outFile = openOutputWaveFile(fileName, sampleRate, numChannels);
-    writeToWaveFile(outFile, outputSamples, outputPos);
-    closeWaveFile(outFile);
-}
-
-int main(int argc, char **argv)
-{
-    if(argc != 4) {
-        printf("Usage: sndadj speed inWavFile outWavFile\n");
-        return 1;
-    }
-    speed = atof(argv[1]);
-    readWaveFile(argv[2]);
-    minPeriod = sampleRate/MAX_FREQ;
-    maxPeriod = sampleRate/MIN_FREQ;
-    printf("Length = %d, sample rate = %d Hz\n", inputLength, sampleRate);
-    period = minPeriod;
-    stepSize = minPeriod/2;
-    prevFilter = (double *)calloc(maxPeriod, sizeof(double));
-    filter = (double *)calloc(maxPeriod, sizeof(double));
-    outputLength = inputLength/speed + 4096;
-    outputSamples = (short *)calloc(outputLength, sizeof(short));
-    playAll();
-    writeWaveFile(argv[3]);
-    return 0;
+        ratio = (int)((pos*reciprocal) >> 32);
+        for(channel = 0; channel < numChannels; channel++) {
+            *out++ = (((1 << 15) - ratio)*prevFilter[channel*maxPeriod + prevFilterPos] +
+                ratio*filter[channel*maxPeriod + filterPos] + (1 << 14)) >> 15;
+        }
+        outputLength++;
+        if(++prevFilterPos == stream->prevPeriod) {
+            prevFilterPos = 0;
+        }
+        if(++filterPos == stream->period) {
+            filterPos = 0;
+        }
+        pos += speed;
+        if(speed != targetSpeed) {
+            speed += speedDelta;
+            if((speedDelta > 0) == (speed > targetSpeed)) {
+                speed = targetSpeed;
+            }
+        }
+    } while(pos < end);
+    play->outputLength = outputLength;
+    play->prevFilterPos = prevFilterPos;
+    play->filterPos = filterPos;
+    play->exactInputPos = (double)(start + pos)/(1 << FIXED_POS_BITS);
+    play->speed = (double)speed/(1 << FIXED_POS_BITS);
+    return true;
+}
+
+// Play a step in fixed point at a steady speed, in runs between filter wraps,
+// as playFilters does, with the fixed point cross-fade kernel.  The ratio and
+// its step per sample are Q30 integers, worked out once per step from the Q16
+// cursor, and truncated, so the Q15 weight stays below 1 << 15.
+static bool playFiltersFixed(
+    sndadjStream stream,
+    playback play)
+{
+    short *prevFilter = stream->fixedPrevFilter;
+    short *filter = stream->fixedFilter;
+    int numChannels = stream->numChannels;
+    int maxPeriod = stream->maxPeriod;
+    short *out = play->outputSamples + play->outputLength*numChannels;
+    int prevFilterPos = play->prevFilterPos;
+    int filterPos = play->filterPos;
+    int stepSize = stream->stepSize;
+    long long start = (stream->inputOffset + stream->inputPos) << FIXED_POS_BITS;
+    long long end = (long long)stepSize << FIXED_POS_BITS;
+    long long pos = getFixedPos(play->exactInputPos) - start;
+    int speed = (int)getFixedPos(play->speed);
+    long long endPos;
+    int ratio, ratioStep, length, i, run, channel;
+
+    if(play->speed != play->targetSpeed) {
+        return playFiltersFixedRamped(stream, play);
+    }
+    if(pos < 0 || pos >= end) {
+        return false;
+    }
+    ratio = (int)((pos << 14)/stepSize);
+    ratioStep = (int)(((long long)speed << 14)/stepSize);
+    length = getFixedPlayLength(pos, end, speed, &endPos);
+    for(i = 0; i < length; i += run) {
+        run = min(length - i, min(stream->prevPeriod - prevFilterPos,
+            stream->period - filterPos));
+        for(channel = 0; channel < numChannels; channel++) {
+            stream->crossFadeFixed(out + i*numChannels + channel, numChannels,
+                prevFilter + channel*maxPeriod + prevFilterPos,
+                filter + channel*maxPeriod + filterPos, ratio + i*ratioStep, ratioStep, run);
+        }
+        prevFilterPos += run;
+        if(prevFilterPos == stream->prevPeriod) {
+            prevFilterPos = 0;
+        }
+        filterPos += run;
+        if(filterPos == stream->period) {
+            filterPos = 0;
+        }
+    }
+    play->outputLength += length;
+    play->prevFilterPos = prevFilterPos;
+    play->filterPos = filterPos;
+    play->exactInputPos = (double)(start + endPos)/(1 << FIXED_POS_BITS);
+    return true;
+}
+
+// Make sure there is room in each output buffer for a step of stepSize samples.
+static bool enlargeOutputBufferIfNeeded(
+    sndadjStream stream,
+    int stepSize)
+{
+    playback play;
+    short *samples;
+    int i, needed, size;
+
+    for(i = 0; i < stream->numSpeeds; i++) {
+        play = stream->playbacks + i;
+        if(play->externalOutput) {
+            // Checked exactly in finishStep, so the caller's buffer can be full.
+            continue;
+        }
+        needed = play->outputLength +
+            (int)(stepSize/min(play->speed, play->targetSpeed)) + 2;
+        if(needed > play->outputSize) {
+            size = needed + (needed >> 1);
+            samples = (short *)realloc(play->outputSamples,
+                size*stream->numChannels*sizeof(short));
+            if(samples == NULL) {
+                return false;
+            }
+            play->outputSamples = samples;
+            play->outputSize = size;
+        }
+    }
+    return true;
+}
+
+// Make the current filter the previous one, so we can compute the next.
+static void startStep(
+    sndadjStream stream,
+    int stepSize)
+{
+    double *temp;
+    short *fixedTemp;
+    struct filterStateStruct state;
+    int i;
+
+    stream->stepSize = stepSize;
+    stream->prevPeriod = stream->period;
+    state = stream->prevFilterState;
+    stream->prevFilterState = stream->filterState;
+    stream->filterState = state;
+    temp = stream->prevFilter;
+    stream->prevFilter = stream->filter;
+    stream->filter = temp;
+    fixedTemp = stream->fixedPrevFilter;
+    stream->fixedPrevFilter = stream->fixedFilter;
+    stream->fixedFilter = fixedTemp;
+    for(i = 0; i < stream->numSpeeds; i++) {
+        stream->playbacks[i].prevFilterPos = stream->playbacks[i].filterPos;
+    }
+}
+
+// Pass the new filter to the loop callback, rounded to shorts.
+static void reportLoop(
+    sndadjStream stream)
+{
+    int numChannels = stream->numChannels;
+    int maxPeriod = stream->maxPeriod;
+    short *samples = stream->loopSamples;
+    double value;
+    int i, channel;
+
+    buildFilter(stream, false, 0, stream->period);
+    if(stream->fixedPoint) {
+        samples = stream->fixedFilter;
+    } else {
+        for(channel = 0; channel < numChannels; channel++) {
+            for(i = 0; i < stream->period; i++) {
+                value = stream->filter[channel*maxPeriod + i];
+                samples[channel*maxPeriod + i] = value >= 0.0? value + 0.5 : value - 0.5;
+            }
+        }
+    }
+    stream->loopCallback(stream->loopUserData, stream->stepSize, stream->period,
+        samples, maxPeriod);
+}
+
+// Pass the state the next step starts from to the seek callback.
+static void reportSeekPoint(
+    sndadjStream stream)
+{
+    sndadjSeekPoint point;
+
+    point.inputPos = stream->inputOffset + stream->inputPos + stream->stepSize -
+        stream->maxPeriod;
+    point.period = stream->period;
+    point.voiced = stream->prevPeriodVoiced;
+    stream->seekCallback(stream->seekUserData, &point);
+}
+
+// Return true if this step fits in the rest of the caller's output buffer.  At
+// a steady speed we know how many samples the step plays, and otherwise we use
+// the upper bound.
+static bool stepFitsOutput(
+    sndadjStream stream,
+    playback play)
+{
+    long long inputPos = stream->inputOffset + stream->inputPos;
+    long long start = inputPos << FIXED_POS_BITS;
+    double endPos;
+    long long fixedEndPos;
+    int length;
+
+    if(play->speed == play->targetSpeed && stream->fixedPoint) {
+        length = getFixedPlayLength(getFixedPos(play->exactInputPos) - start,
+            (long long)stream->stepSize << FIXED_POS_BITS, (int)getFixedPos(play->speed),
+            &fixedEndPos);
+    } else if(play->speed == play->targetSpeed) {
+        length = getPlayLength(play->exactInputPos, (double)inputPos, play->speed,
+            stream->stepSize, &endPos);
+    } else {
+        length = getStepLength(stream, play);
+    }
+    return play->outputLength + length <= play->outputSize;
+}
+
+// Play from the previous filter to the new one at each speed, and move to the
+// next step.  Return false if a playback position leaves the step, or would
+// write past the end of the caller's output buffer.
+static bool finishStep(
+    sndadjStream stream)
+{
+    playback play;
+    int i, length;
+    bool passed = true;
+
+    if(stream->loopCallback != NULL) {
+        reportLoop(stream);
+    }
+    if(!stream->analysisOnly) {
+        stream->started = true;
+        PROFILE_START(stream);
+        for(i = 0; i < stream->numSpeeds; i++) {
+            play = stream->playbacks + i;
+            computeFilterPos(stream, play);
+            length = getStepLength(stream, play);
+            buildFilter(stream, true, play->prevFilterPos, length);
+            buildFilter(stream, false, play->filterPos, length);
+        }
+        PROFILE_STOP(stream, filterNanoseconds);
+        PROFILE_START(stream);
+        for(i = 0; passed && i < stream->numSpeeds; i++) {
+            play = stream->playbacks + i;
+            if(play->externalOutput && !stepFitsOutput(stream, play)) {
+                passed = false;
+            } else if(stream->fixedPoint) {
+                passed = playFiltersFixed(stream, play);
+            } else {
+                passed = playFilters(stream, play);
+            }
+        }
+        PROFILE_STOP(stream, playNanoseconds);
+    }
+    stream->inputPos += stream->stepSize;
+    return passed;
+}
+
+// Return the number of periods per step.  When it is automatic, it is picked
+// from the slowest playback speed, since that speed hears the most of each
+// step.  Up to 2X we step a period at a time.  Above that, the step grows with
+// the speed up to MAX_AUTO_STEP_SCALE periods at 3X, which still scores within
+// the quality baselines of single period steps, with a third fewer steps.
+static double getStepScale(
+    sndadjStream stream)
+{
+    double speed;
+    int i;
+
+    if(stream->stepScale > 0.0) {
+        return stream->stepScale;
+    }
+    speed = stream->playbacks[0].targetSpeed;
+    for(i = 1; i < stream->numSpeeds; i++) {
+        speed = min(speed, stream->playbacks[i].targetSpeed);
+    }
+    return min(max(speed/2.0, 1.0), MAX_AUTO_STEP_SCALE);
+}
+
+// Return the size of a step from a filter of this period to the next.  It is
+// longer than the fastest playback moves in one output sample, or ramping
+// towards, so a playback can't jump from before a step to past its end.
+static int getStepSize(
+    sndadjStream stream,
+    int period)
+{
+    double speed = 0.0;
+    int i;
+
+    for(i = 0; i < stream->numSpeeds; i++) {
+        speed = max(speed, max(stream->playbacks[i].speed, stream->playbacks[i].targetSpeed));
+    }
+    return max((int)(getStepScale(stream)*period), (int)speed + 1);
+}
+
+// Generate samples until the current playback point has passed the next filter
+// location.  We assume we have already started the current filter and it's
+// period, and now need to start the new one stepSize samples on.  The filters
+// are computed as playback reaches them, in finishStep.  Return false if a
+// playback position leaves the step.
+static bool generateSamplesForOneStep(
+    sndadjStream stream,
+    int stepSize)
+{
+    startStep(stream, stepSize);
+    PROFILE_START(stream);
+    stream->period = findPitchPeriod(stream,
+        stream->pitchSamples + stream->inputPos + stream->stepSize);
+    PROFILE_STOP(stream, pitchNanoseconds);
+    if(stream->seekCallback != NULL) {
+        reportSeekPoint(stream);
+    }
+    startFilter(stream, stream->inputOffset + stream->inputPos + stream->stepSize);
+#ifdef SNDADJ_PROFILE
+    stream->profile.numSteps++;
+#endif
+    return finishStep(stream);
+}
+
+// Make sure there is room in the input buffer for numSamples more samples.
+static bool enlargeInputBufferIfNeeded(
+    sndadjStream stream,
+    int numSamples)
+{
+    int needed = stream->inputLength + numSamples;
+    int size;
+    short *samples;
+
+    if(needed > stream->inputSize) {
+        // On failure the old buffers and size are kept, so a reset still works.
+        size = needed + (needed >> 1);
+        samples = (short *)realloc(stream->inputSamples,
+            size*stream->numChannels*sizeof(short));
+        if(samples == NULL) {
+            return false;
+        }
+        stream->inputSamples = samples;
+        if(stream->numChannels == 1) {
+            stream->pitchSamples = samples;
+        } else {
+            samples = (short *)realloc(stream->pitchSamples, size*sizeof(short));
+            if(samples == NULL) {
+                return false;
+            }
+            stream->pitchSamples = samples;
+        }
+        stream->inputSize = size;
+    }
+    return true;
+}
+
+// Add numSamples frames to the end of the input, and down-mix them for the
+// pitch search.
+static void addInput(
+    sndadjStream stream,
+    const short *samples,
+    int numSamples)
+{
+    int numChannels = stream->numChannels;
+    short *p = stream->pitchSamples + stream->inputLength;
+    int i, channel, value;
+
+    memcpy(stream->inputSamples + stream->inputLength*numChannels, samples,
+        numSamples*numChannels*sizeof(short));
+    stream->inputLength += numSamples;
+    if(numChannels == 1) {
+        return;
+    }
+    for(i = 0; i < numSamples; i++) {
+        value = 0;
+        for(channel = 0; channel < numChannels; channel++) {
+            value += *samples++;
+        }
+        *p++ = value/numChannels;
+    }
+}
+
+// Drop input samples we will never look at again.  The next pitch search looks
+// back at most maxPeriod samples from inputPos + stepSize, so keeping maxPeriod
+// samples of history before inputPos is enough.
+static void removeProcessedInput(
+    sndadjStream stream)
+{
+    int numSamples = stream->inputPos - stream->maxPeriod;
+
+    if(numSamples <= 0) {
+        return;
+    }
+    memmove(stream->inputSamples, stream->inputSamples + numSamples*stream->numChannels,
+        (stream->inputLength - numSamples)*stream->numChannels*sizeof(short));
+    if(stream->numChannels != 1) {
+        memmove(stream->pitchSamples, stream->pitchSamples + numSamples,
+            (stream->inputLength - numSamples)*sizeof(short));
+    }
+    stream->inputLength -= numSamples;
+    stream->inputPos -= numSamples;
+    stream->inputOffset += numSamples;
+}
+
+// Start the filter at inputPos that a seek left us in the middle of, now that
+// we have the input for it.
+static void rebuildFilter(
+    sndadjStream stream)
+{
+    startFilter(stream, stream->inputOffset + stream->inputPos);
+    stream->seekPending = false;
+}
+
+// Run as many steps as we have input for.  A step searches for a pitch period
+// starting stepSize samples past inputPos, and looks up to maxPeriod samples
+// beyond that.  The step size is a scale of the current period.
+static bool processInput(
+    sndadjStream stream,
+    int inputEnd)
+{
+    int stepSize = getStepSize(stream, stream->period);
+
+    while(stream->inputPos < inputEnd &&
+            stream->inputPos + stepSize + stream->maxPeriod <= stream->inputLength) {
+        if(!enlargeOutputBufferIfNeeded(stream, stepSize)) {
+            return false;
+        }
+        if(stream->seekPending) {
+            rebuildFilter(stream);
+        }
+        if(!generateSamplesForOneStep(stream, stepSize)) {
+            return false;
+        }
+        stepSize = getStepSize(stream, stream->period);
+    }
+    return true;
+}
+
+// Free the buffers used by the YIN engine.
+static void freeYinBuffers(
+    sndadjStream stream)
+{
+    if(stream->yinPlan != NULL) {
+        destroyFFTPlan(stream->yinPlan);
+        stream->yinPlan = NULL;
+    }
+    if(stream->fftReal != NULL) {
+        free(stream->fftReal);
+        stream->fftReal = NULL;
+    }
+    if(stream->fftImag != NULL) {
+        free(stream->fftImag);
+        stream->fftImag = NULL;
+    }
+    if(stream->yinEnergy != NULL) {
+        free(stream->yinEnergy);
+        stream->yinEnergy = NULL;
+    }
+    if(stream->yinDiff != NULL) {
+        free(stream->yinDiff);
+        stream->yinDiff = NULL;
+    }
+}
+
+// Allocate the buffers used by the YIN engine.  The FFT has to hold the whole
+// 2*maxPeriod segment around the step.
+static bool allocateYinBuffers(
+    sndadjStream stream)
+{
+    int size = 2;
+
+    while(size < 2*stream->maxPeriod) {
+        size <<= 1;
+    }
+    stream->yinPlan = createFFTPlan(size);
+    stream->fftReal = (double *)calloc(size, sizeof(double));
+    stream->fftImag = (double *)calloc(size, sizeof(double));
+    stream->yinEnergy = (double *)calloc(2*stream->maxPeriod + 1, sizeof(double));
+    stream->yinDiff = (double *)calloc(stream->maxPeriod + 1, sizeof(double));
+    if(stream->yinPlan == NULL || stream->fftReal == NULL || stream->fftImag == NULL ||
+            stream->yinEnergy == NULL || stream->yinDiff == NULL) {
+        freeYinBuffers(stream);
+        return false;
+    }
+    return true;
+}
+
+// Free the running sums of the sliding engine.
+static void freeLagSums(
+    sndadjStream stream)
+{
+    if(stream->lagSums != NULL) {
+        free(stream->lagSums);
+        stream->lagSums = NULL;
+    }
+    if(stream->lagPositions != NULL) {
+        free(stream->lagPositions);
+        stream->lagPositions = NULL;
+    }
+}
+
+// Allocate a running sum for every period the sliding engine could search.
+static bool allocateLagSums(
+    sndadjStream stream)
+{
+    stream->lagSums = (long long *)calloc(stream->maxPeriod + 1, sizeof(long long));
+    stream->lagPositions = (long long *)calloc(stream->maxPeriod + 1, sizeof(long long));
+    if(stream->lagSums == NULL || stream->lagPositions == NULL) {
+        freeLagSums(stream);
+        return false;
+    }
+    clearLagSums(stream);
+    return true;
+}
+
+// Free the filters of one mode: the double filters and the shorts they are
+// rounded to for the loop callback, or the fixed point filters.
+static void freeFilters(
+    sndadjStream stream,
+    bool fixedPoint)
+{
+    if(fixedPoint) {
+        if(stream->fixedFilter != NULL) {
+            free(stream->fixedFilter);
+        }
+        if(stream->fixedPrevFilter != NULL) {
+            free(stream->fixedPrevFilter);
+        }
+        stream->fixedFilter = NULL;
+        stream->fixedPrevFilter = NULL;
+    } else {
+        if(stream->filter != NULL) {
+            free(stream->filter);
+        }
+        if(stream->prevFilter != NULL) {
+            free(stream->prevFilter);
+        }
+        if(stream->loopSamples != NULL) {
+            free(stream->loopSamples);
+        }
+        stream->filter = NULL;
+        stream->prevFilter = NULL;
+        stream->loopSamples = NULL;
+    }
+}
+
+// Allocate the silent filters of one mode.  A stream only has the filters of
+// the mode it is in.  Return false if out of memory.
+static bool allocateFilters(
+    sndadjStream stream,
+    bool fixedPoint)
+{
+    int size = stream->maxPeriod*stream->numChannels;
+
+    if(fixedPoint) {
+        stream->fixedFilter = (short *)calloc(size, sizeof(short));
+        stream->fixedPrevFilter = (short *)calloc(size, sizeof(short));
+        if(stream->fixedFilter == NULL || stream->fixedPrevFilter == NULL) {
+            freeFilters(stream, true);
+            return false;
+        }
+    } else {
+        stream->filter = (double *)calloc(size, sizeof(double));
+        stream->prevFilter = (double *)calloc(size, sizeof(double));
+        stream->loopSamples = (short *)calloc(size, sizeof(short));
+        if(stream->filter == NULL || stream->prevFilter == NULL ||
+                stream->loopSamples == NULL) {
+            freeFilters(stream, false);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Create a stream.
+sndadjStream sndadjCreateStream(
+    int sampleRate,
+    int numChannels)
+{
+    sndadjStream stream = (sndadjStream)calloc(1, sizeof(struct sndadjStreamStruct));
+
+    if(stream == NULL) {
+        return NULL;
+    }
+    stream->sampleRate = sampleRate;
+    stream->numChannels = numChannels;
+    stream->playbacks = (struct playbackStruct *)calloc(1, sizeof(struct playbackStruct));
+    if(stream->playbacks == NULL) {
+        free(stream);
+        return NULL;
+    }
+    stream->playbacks[0].speed = 1.0;
+    stream->playbacks[0].targetSpeed = 1.0;
+    stream->numSpeeds = 1;
+    stream->speedsSize = 1;
+    stream->sumAbsDiff = selectSumAbsDiff();
+    stream->sumAbsDiffBounded = selectSumAbsDiffBounded();
+    stream->slideAbsDiff = selectSlideAbsDiff();
+    stream->crossFade = selectCrossFade();
+    stream->crossFadeFixed = selectCrossFadeFixed();
+    stream->mixPeriods = selectMixPeriods();
+    stream->mixPeriodsFixed = selectMixPeriodsFixed();
+    stream->decimation = 1;
+    stream->stepScale = 1.0;
+    stream->minPeriod = sampleRate/MAX_FREQ;
+    stream->maxPeriod = sampleRate/MIN_FREQ;
+    stream->rampTable = getRampTable(stream->maxPeriod);
+    stream->inputSize = 1024 + 3*stream->maxPeriod;
+    stream->inputSamples = (short *)calloc(stream->inputSize*numChannels, sizeof(short));
+    if(numChannels == 1) {
+        stream->pitchSamples = stream->inputSamples;
+    } else {
+        stream->pitchSamples = (short *)calloc(stream->inputSize, sizeof(short));
+    }
+    if(!allocateFilters(stream, false) || stream->rampTable == NULL ||
+            stream->inputSamples == NULL || stream->pitchSamples == NULL) {
+        sndadjDestroyStream(stream);
+        return NULL;
+    }
+    sndadjResetStream(stream);
+    return stream;
+}
+
+// Get the stream ready for new input, keeping its buffers and settings.  The
+// input buffer starts with maxPeriod zeros, and the filters start silent.  A
+// speed ramp in progress is cut short, so playback starts at the target speed.
+void sndadjResetStream(
+    sndadjStream stream)
+{
+    int numChannels = stream->numChannels;
+    int maxPeriod = stream->maxPeriod;
+    int i;
+
+    memset(stream->inputSamples, 0, maxPeriod*numChannels*sizeof(short));
+    if(numChannels != 1) {
+        memset(stream->pitchSamples, 0, maxPeriod*sizeof(short));
+    }
+    if(stream->filter != NULL) {
+        memset(stream->filter, 0, maxPeriod*numChannels*sizeof(double));
+        memset(stream->prevFilter, 0, maxPeriod*numChannels*sizeof(double));
+    }
+    setFilterBuilt(&stream->filterState);
+    setFilterBuilt(&stream->prevFilterState);
+    if(stream->fixedFilter != NULL) {
+        memset(stream->fixedFilter, 0, maxPeriod*numChannels*sizeof(short));
+        memset(stream->fixedPrevFilter, 0, maxPeriod*numChannels*sizeof(short));
+    }
+    stream->inputLength = maxPeriod;
+    stream->inputPos = maxPeriod; // Skip initial zeros.
+    stream->inputOffset = 0;
+    stream->period = stream->minPeriod;
+    stream->prevPeriod = 0;
+    stream->stepSize = stream->minPeriod/2;
+    stream->prevPeriodVoiced = false;
+    stream->seekPending = false;
+    stream->started = false;
+    clearLagSums(stream);
+#ifdef SNDADJ_PROFILE
+    memset(&stream->profile, 0, sizeof(sndadjProfile));
+#endif
+    for(i = 0; i < stream->numSpeeds; i++) {
+        stream->playbacks[i].exactInputPos = maxPeriod;
+        stream->playbacks[i].speed = stream->playbacks[i].targetSpeed;
+        stream->playbacks[i].speedDelta = 0.0;
+        stream->playbacks[i].outputLength = 0;
+        stream->playbacks[i].filterPos = 0;
+        stream->playbacks[i].prevFilterPos = 0;
+    }
+}
+
+// Free all the memory owned by the stream.
+void sndadjDestroyStream(
+    sndadjStream stream)
+{
+    int i;
+
+    if(stream->pitchSamples != NULL && stream->pitchSamples != stream->inputSamples) {
+        free(stream->pitchSamples);
+    }
+    if(stream->inputSamples != NULL) {
+        free(stream->inputSamples);
+    }
+    for(i = 0; i < stream->speedsSize; i++) {
+        if(stream->playbacks[i].outputSamples != NULL) {
+            free(stream->playbacks[i].outputSamples);
+        }
+    }
+    free(stream->playbacks);
+    freeFilters(stream, false);
+    freeFilters(stream, true);
+    if(stream->downSampleBuffer != NULL) {
+        free(stream->downSampleBuffer);
+    }
+    freeYinBuffers(stream);
+    freeLagSums(stream);
+    free(stream);
+}
+
+// Round a speed or position to the fixed point grid, in fixed point mode.
+static double toFixedGrid(
+    sndadjStream stream,
+    double value)
+{
+    if(!stream->fixedPoint) {
+        return value;
+    }
+    return round(value*(1 << FIXED_POS_BITS))/(1 << FIXED_POS_BITS);
+}
+
+// Return how much a playback's speed changes per output sample to ramp to the
+// target speed over speedRamp seconds.  In fixed point mode, a step too small
+// for the grid is rounded up to one grid step, so the ramp still ends.
+static double getSpeedDelta(
+    sndadjStream stream,
+    playback play)
+{
+    double delta = toFixedGrid(stream, (play->targetSpeed - play->speed)/
+        (stream->speedRamp*stream->sampleRate));
+
+    if(stream->fixedPoint && delta == 0.0 && play->targetSpeed != play->speed) {
+        delta = (play->targetSpeed > play->speed? 1.0 : -1.0)/(1 << FIXED_POS_BITS);
+    }
+    return delta;
+}
+
+// Change the speed of one playback.  Once the stream has started playing, the
+// change is spread over speedRamp seconds of output, so there is no sudden jump
+// in the rate.
+static void setPlaybackSpeed(
+    sndadjStream stream,
+    playback play,
+    double speed)
+{
+    play->targetSpeed = toFixedGrid(stream, speed);
+    if(!stream->started || stream->speedRamp <= 0.0) {
+        play->speed = play->targetSpeed;
+        play->speedDelta = 0.0;
+    } else {
+        play->speedDelta = getSpeedDelta(stream, play);
+    }
+}
+
+// Return true if the speed is in range.  This is false for NaN.
+static bool isValidSpeed(
+    double speed)
+{
+    return speed >= SNDADJ_MIN_SPEED && speed <= SNDADJ_MAX_SPEED;
+}
+
+// Set the playback speed.  Any other speeds are dropped.  A speed out of range
+// would stop playback advancing, so it is ignored.
+void sndadjSetSpeed(
+    sndadjStream stream,
+    double speed)
+{
+    if(!isValidSpeed(speed)) {
+        return;
+    }
+    setPlaybackSpeed(stream, stream->playbacks, speed);
+    stream->numSpeeds = 1;
+}
+
+// Return the playback speed, or the first one if there are several.  While a
+// speed change is being ramped, this is the speed being ramped to.
+double sndadjGetSpeed(
+    sndadjStream stream)
+{
+    return stream->playbacks[0].targetSpeed;
+}
+
+// Set how long speed changes take to ramp in.
+void sndadjSetSpeedRamp(
+    sndadjStream stream,
+    double seconds)
+{
+    stream->speedRamp = seconds;
+}
+
+// Return how long speed changes take to ramp in.
+double sndadjGetSpeedRamp(
+    sndadjStream stream)
+{
+    return stream->speedRamp;
+}
+
+// Play the filters at each of the speeds.  Speeds we add start from where the
+// first one is, so this is only useful before writing any samples, or right
+// after a reset.
+bool sndadjSetSpeeds(
+    sndadjStream stream,
+    const double *speeds,
+    int numSpeeds)
+{
+    struct playbackStruct *playbacks;
+    int i;
+
+    if(numSpeeds < 1) {
+        return false;
+    }
+    for(i = 0; i < numSpeeds; i++) {
+        if(!isValidSpeed(speeds[i])) {
+            return false;
+        }
+    }
+    if(numSpeeds > stream->speedsSize) {
+        playbacks = (struct playbackStruct *)realloc(stream->playbacks,
+            numSpeeds*sizeof(struct playbackStruct));
+        if(playbacks == NULL) {
+            return false;
+        }
+        memset(playbacks + stream->speedsSize, 0,
+            (numSpeeds - stream->speedsSize)*sizeof(struct playbackStruct));
+        stream->playbacks = playbacks;
+        stream->speedsSize = numSpeeds;
+    }
+    for(i = 0; i < numSpeeds; i++) {
+        if(i >= stream->numSpeeds) {
+            stream->playbacks[i].exactInputPos = stream->playbacks[0].exactInputPos;
+            stream->playbacks[i].filterPos = stream->playbacks[0].filterPos;
+            stream->playbacks[i].prevFilterPos = stream->playbacks[0].prevFilterPos;
+            stream->playbacks[i].outputLength = 0;
+            stream->playbacks[i].speed = toFixedGrid(stream, speeds[i]);
+        }
+        setPlaybackSpeed(stream, stream->playbacks + i, speeds[i]);
+    }
+    stream->numSpeeds = numSpeeds;
+    return true;
+}
+
+// Return the number of playback speeds.
+int sndadjGetNumSpeeds(
+    sndadjStream stream)
+{
+    return stream->numSpeeds;
+}
+
+// Set the decimation factor of the coarse pitch search.  Only 1, 2 and 4 are
+// supported.  0 picks the largest of those which keeps the coarse search at or
+// above MIN_DECIMATED_RATE.
+bool sndadjSetDecimation(
+    sndadjStream stream,
+    int decimation)
+{
+    if(decimation == 0) {
+        decimation = 4;
+        while(decimation > 1 && stream->sampleRate/decimation < MIN_DECIMATED_RATE) {
+            decimation >>= 1;
+        }
+    }
+    if(decimation != 1 && decimation != 2 && decimation != 4) {
+        return false;
+    }
+    if(decimation > 1 && stream->downSampleBuffer == NULL) {
+        stream->downSampleBuffer = (short *)calloc(2*stream->maxPeriod, sizeof(short));
+        if(stream->downSampleBuffer == NULL) {
+            return false;
+        }
+    }
+    stream->decimation = decimation;
+    return true;
+}
+
+// Return the decimation factor of the coarse pitch search.
+int sndadjGetDecimation(
+    sndadjStream stream)
+{
+    return stream->decimation;
+}
+
+// Turn the pruned AMDF search on or off.
+void sndadjSetPrunedSearch(
+    sndadjStream stream,
+    bool prunedSearch)
+{
+    stream->prunedSearch = prunedSearch;
+}
+
+// Return true if the AMDF search is pruned.
+bool sndadjGetPrunedSearch(
+    sndadjStream stream)
+{
+    return stream->prunedSearch;
+}
+
+// Turn the silence and unvoiced fast path on or off.
+void sndadjSetSkipUnvoiced(
+    sndadjStream stream,
+    bool skipUnvoiced)
+{
+    stream->skipUnvoiced = skipUnvoiced;
+}
+
+// Return true if silent and unvoiced steps skip the pitch search.
+bool sndadjGetSkipUnvoiced(
+    sndadjStream stream)
+{
+    return stream->skipUnvoiced;
+}
+
+// Set the number of periods per step, or 0 to pick it from the speed.
+bool sndadjSetStepScale(
+    sndadjStream stream,
+    double stepScale)
+{
+    if(stepScale != 0.0 && (stepScale < MIN_STEP_SCALE || stepScale > MAX_STEP_SCALE)) {
+        return false;
+    }
+    stream->stepScale = stepScale;
+    return true;
+}
+
+// Return the number of periods per step, or 0 if it is picked from the speed.
+double sndadjGetStepScale(
+    sndadjStream stream)
+{
+    return stream->stepScale;
+}
+
+// Select the pitch estimator.
+bool sndadjSetPitchEngine(
+    sndadjStream stream,
+    sndadjPitchEngine pitchEngine)
+{
+    if(pitchEngine == SNDADJ_PITCH_YIN) {
+        if(stream->yinPlan == NULL && !allocateYinBuffers(stream)) {
+            return false;
+        }
+    } else if(pitchEngine == SNDADJ_PITCH_SLIDING) {
+        if(stream->lagSums == NULL && !allocateLagSums(stream)) {
+            return false;
+        }
+    } else if(pitchEngine != SNDADJ_PITCH_AMDF) {
+        return false;
+    }
+    stream->pitchEngine = pitchEngine;
+    return true;
+}
+
+// Return the pitch estimator in use.
+sndadjPitchEngine sndadjGetPitchEngine(
+    sndadjStream stream)
+{
+    return stream->pitchEngine;
+}
+
+// Switch between the double precision filters, which are the reference, and
+// 16-bit filters mixed with integer arithmetic.  The filters of the new mode
+// replace those of the old one, which are freed.  Going to fixed point moves
+// the speeds and playback positions onto the fixed point grid.
+bool sndadjSetFixedPoint(
+    sndadjStream stream,
+    bool fixedPoint)
+{
+    playback play;
+    int i;
+
+    if(fixedPoint == stream->fixedPoint) {
+        return true;
+    }
+    if(!allocateFilters(stream, fixedPoint)) {
+        return false;
+    }
+    freeFilters(stream, !fixedPoint);
+    stream->fixedPoint = fixedPoint;
+    for(i = 0; i < stream->numSpeeds; i++) {
+        play = stream->playbacks + i;
+        play->speed = toFixedGrid(stream, play->speed);
+        play->targetSpeed = toFixedGrid(stream, play->targetSpeed);
+        play->exactInputPos = toFixedGrid(stream, play->exactInputPos);
+        if(play->speedDelta != 0.0) {
+            play->speedDelta = getSpeedDelta(stream, play);
+        }
+    }
+    return true;
+}
+
+// Return true if the stream uses fixed point filters.
+bool sndadjGetFixedPoint(
+    sndadjStream stream)
+{
+    return stream->fixedPoint;
+}
+
+// Set the function called with each new filter.
+void sndadjSetLoopCallback(
+    sndadjStream stream,
+    sndadjLoopCallback callback,
+    void *userData)
+{
+    stream->loopCallback = callback;
+    stream->loopUserData = userData;
+}
+
+// Turn playback of the filters on or off.
+void sndadjSetAnalysisOnly(
+    sndadjStream stream,
+    bool analysisOnly)
+{
+    stream->analysisOnly = analysisOnly;
+}
+
+// Set the function called with the result of every pitch search.
+void sndadjSetTraceCallback(
+    sndadjStream stream,
+    sndadjTraceCallback callback,
+    void *userData)
+{
+    stream->traceCallback = callback;
+    stream->traceUserData = userData;
+}
+
+// Set the function called with each point the stream could be restarted from.
+void sndadjSetSeekCallback(
+    sndadjStream stream,
+    sndadjSeekCallback callback,
+    void *userData)
+{
+    stream->seekCallback = callback;
+    stream->seekUserData = userData;
+}
+
+// Restart the stream from a seek point, as if all the input before it had been
+// written.  The history before the seek point goes into the input buffer as it
+// would have been, so the pitch search picks up exactly where the first pass
+// was at that point.  The filter playback fades out of has to wait for a period
+// of input past the seek point, so it is rebuilt in processInput.
+bool sndadjSeekStream(
+    sndadjStream stream,
+    const sndadjSeekPoint *point,
+    const short *samples,
+    int historyLength)
+{
+    int maxPeriod = stream->maxPeriod;
+    int i;
+
+    if(point->inputPos < 0 || point->period < 1 || point->period > maxPeriod ||
+            historyLength < 0) {
+        return false;
+    }
+    // This also ends any speed ramp, as the header promises.
+    sndadjResetStream(stream);
+    historyLength = min(historyLength, maxPeriod);
+    stream->inputLength = maxPeriod - historyLength;
+    addInput(stream, samples - historyLength*stream->numChannels, historyLength);
+    stream->inputOffset = point->inputPos;
+    stream->period = point->period;
+    stream->prevPeriodVoiced = point->voiced;
+    stream->seekPending = true;
+    for(i = 0; i < stream->numSpeeds; i++) {
+        stream->playbacks[i].exactInputPos = (double)(point->inputPos + maxPeriod);
+    }
+    return true;
+}
+
+// Return the time spent in each stage since the stream was last reset.
+void sndadjGetProfile(
+    sndadjStream stream,
+    sndadjProfile *profile)
+{
+#ifdef SNDADJ_PROFILE
+    *profile = stream->profile;
+#else
+    memset(profile, 0, sizeof(sndadjProfile));
+#endif
+}
+
+// Return the longest pitch period the stream looks for.
+int sndadjGetMaxPeriod(
+    sndadjStream stream)
+{
+    return stream->maxPeriod;
+}
+
+// Return the sample rate of the stream.
+int sndadjGetSampleRate(
+    sndadjStream stream)
+{
+    return stream->sampleRate;
+}
+
+// Return the number of channels of the stream.
+int sndadjGetNumChannels(
+    sndadjStream stream)
+{
+    return stream->numChannels;
+}
+
+// Append input samples to the stream, and generate as much output as we can.
+bool sndadjWriteSamplesToStream(
+    sndadjStream stream,
+    const short *samples,
+    int numSamples)
+{
+    removeProcessedInput(stream);
+    if(!enlargeInputBufferIfNeeded(stream, numSamples)) {
+        return false;
+    }
+    addInput(stream, samples, numSamples);
+    return processInput(stream, stream->inputLength);
+}
+
+// Return the number of zeros the end of the input is padded with, which is
+// enough for a step from the last input sample, and a pitch search past it.
+static int getPaddingLength(
+    sndadjStream stream)
+{
+    return stream->maxPeriod + max(getStepSize(stream, stream->maxPeriod), stream->maxPeriod);
+}
+
+// Play out the rest of the input.  The end of the input is padded with zeros so
+// the last pitch search can look a full period past the end.  No more samples
+// should be written to the stream after it is flushed, until it is reset.
+bool sndadjFlushStream(
+    sndadjStream stream)
+{
+    int inputEnd = stream->inputLength;
+    int padding = getPaddingLength(stream);
+
+    if(!enlargeInputBufferIfNeeded(stream, padding)) {
+        return false;
+    }
+    memset(stream->inputSamples + stream->inputLength*stream->numChannels, 0,
+        padding*stream->numChannels*sizeof(short));
+    if(stream->numChannels != 1) {
+        memset(stream->pitchSamples + stream->inputLength, 0, padding*sizeof(short));
+    }
+    stream->inputLength += padding;
+    if(!processInput(stream, inputEnd)) {
+        return false;
+    }
+    stream->inputLength = inputEnd;
+    return true;
+}
+
+// Play one precomputed filter, as if it had just been computed from the input.
+// samples holds period samples for each channel, with channel c starting at
+// samples[c*stride].
+bool sndadjWriteLoopToStream(
+    sndadjStream stream,
+    int stepSize,
+    int period,
+    const short *samples,
+    int stride)
+{
+    int maxPeriod = stream->maxPeriod;
+    int i, channel;
+
+    if(period < 1 || period > maxPeriod || stepSize < 1) {
+        return false;
+    }
+    if(!enlargeOutputBufferIfNeeded(stream, stepSize)) {
+        return false;
+    }
+    startStep(stream, stepSize);
+    stream->period = period;
+    setFilterBuilt(&stream->filterState);
+    for(channel = 0; channel < stream->numChannels; channel++) {
+        for(i = 0; i < period; i++) {
+            if(stream->fixedPoint) {
+                stream->fixedFilter[channel*maxPeriod + i] = samples[channel*stride + i];
+            } else {
+                stream->filter[channel*maxPeriod + i] = samples[channel*stride + i];
+            }
+        }
+    }
+    return finishStep(stream);
+}
+
+// Return the most output frames a clip of inputLength frames can generate at
+// the first speed.  Every step generates at most one more frame than its share
+// of the input at the slowest speed it ramps through, and the steps run at most
+// through the padding at the end.
+int sndadjGetMaxOutputLength(
+    sndadjStream stream,
+    int inputLength)
+{
+    playback play = stream->playbacks;
+    double speed = min(play->speed, play->targetSpeed);
+    double length = inputLength + (double)getPaddingLength(stream);
+
+    return (int)(length/speed + length/getStepSize(stream, stream->minPeriod)) + 3;
+}
+
+// Process a whole clip, with playback writing straight into the caller's
+// output buffer.  The input is still copied into the stream a chunk at a time,
+// since the pitch search needs history and padding around it.
+int sndadjProcessBuffer(
+    sndadjStream stream,
+    const short *input,
+    int inputLength,
+    short *output,
+    int maxOutput)
+{
+    playback play = stream->playbacks;
+    short *outputSamples = play->outputSamples;
+    int outputSize = play->outputSize;
+    int pos, numSamples, outputLength;
+    bool passed = true;
+
+    sndadjResetStream(stream);
+    play->outputSamples = output;
+    play->outputSize = maxOutput;
+    play->externalOutput = true;
+    for(pos = 0; passed && pos < inputLength; pos += numSamples) {
+        numSamples = min(inputLength - pos, PROCESS_CHUNK);
+        passed = sndadjWriteSamplesToStream(stream, input + pos*stream->numChannels,
+            numSamples);
+    }
+    if(passed) {
+        passed = sndadjFlushStream(stream);
+    }
+    outputLength = play->outputLength;
+    play->outputSamples = outputSamples;
+    play->outputSize = outputSize;
+    play->outputLength = 0;
+    play->externalOutput = false;
+    return passed? outputLength : -1;
+}
+
+// Return the number of output samples available to be read.
+int sndadjSamplesAvailable(
+    sndadjStream stream)
+{
+    return stream->playbacks[0].outputLength;
+}
+
+// Read up to maxSamples output samples.  Return the number actually read.
+int sndadjReadSamplesFromStream(
+    sndadjStream stream,
+    short *samples,
+    int maxSamples)
+{
+    return sndadjReadSamplesAtSpeed(stream, 0, samples, maxSamples);
+}
+
+// Return the number of output samples available at the speed with the given
+// index.
+int sndadjSamplesAvailableAtSpeed(
+    sndadjStream stream,
+    int speedIndex)
+{
+    return stream->playbacks[speedIndex].outputLength;
+}
+
+// Read up to maxSamples output samples generated at the speed with the given
+// index.  Return the number actually read.
+int sndadjReadSamplesAtSpeed(
+    sndadjStream stream,
+    int speedIndex,
+    short *samples,
+    int maxSamples)
+{
+    playback play = stream->playbacks + speedIndex;
+    int numSamples = play->outputLength;
+
+    if(numSamples > maxSamples) {
+        numSamples = maxSamples;
+    }
+    memcpy(samples, play->outputSamples, numSamples*stream->numChannels*sizeof(short));
+    play->outputLength -= numSamples;
+    memmove(play->outputSamples, play->outputSamples + numSamples*stream->numChannels,
+        play->outputLength*stream->numChannels*sizeof(short));
+    return numSamples;
 }
@@ -0,0 +1,248 @@
+/*
+Sndadj speeds up or slows down speech by building a loop-able pitch period
+"filter" at each step through the input, and cross-fading from one filter to the
+next at the desired playback speed.  All of the state for one speed change lives
+in a sndadjStream, so a single process can run as many independent streams as
+it likes.
+
+Streams may have any number of channels.  Samples are interleaved, and sample
+counts are always in frames of numChannels samples.  The pitch period is found
+from a down-mix of all the channels, and the same period and filter positions
+are applied to each of them.
+
+The library never exits or prints.  Calls that process samples return false if
+out of memory, or if a playback passes over a whole step in one output sample,
+which only a loop with a step size shorter than the speed can cause.  Reset the
+stream after a failure.
+*/
+
+#ifndef SNDADJ_H
+#define SNDADJ_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sndadjStreamStruct;
+typedef struct sndadjStreamStruct *sndadjStream;
+
+// The range of playback speeds.  Speeds outside it, including NaN, are refused.
+#define SNDADJ_MIN_SPEED 0.01
+#define SNDADJ_MAX_SPEED 100.0
+
+// Pitch estimators.  The AMDF searches each candidate period directly.  YIN
+// computes the cumulative mean normalized difference for every lag with one FFT
+// per step, so its cost grows as N log N rather than N^2 with the sample rate,
+// and it gives a more robust voicing decision.  The sliding engine finds the
+// same periods as the AMDF, but keeps each period's sum from one search to the
+// next, and only adds and subtracts the samples that slid in and out of the
+// window.  Sliding a sum costs twice the step, so it only saves work with a step
+// scale of 0.5 or less, set by sndadjSetStepScale.  It saves about a fifth of
+// the search at 0.5, and two fifths at 0.25.  At the default scale of 1, it
+// costs the same as the AMDF.  Neither YIN nor the sliding engine use
+// decimation or pruning.
+typedef enum {
+    SNDADJ_PITCH_AMDF,
+    SNDADJ_PITCH_YIN,
+    SNDADJ_PITCH_SLIDING
+} sndadjPitchEngine;
+
+// The result of one pitch search, passed to the trace callback.  minDiff and
+// aveDiff are the average difference per sample at the chosen period, and
+// averaged over all the periods searched.
+typedef struct {
+    long long inputPos; // Input sample, not counting padding, the search was centered on
+    int period;
+    long long minDiff, aveDiff;
+    bool voiced;
+} sndadjPitchTrace;
+
+typedef void (*sndadjTraceCallback)(void *userData, const sndadjPitchTrace *trace);
+
+// Time spent in each stage of processing, for benchmarks.  Playing includes
+// every speed.
+typedef struct {
+    long long pitchNanoseconds; // Searching for the pitch period
+    long long filterNanoseconds; // Computing the filters
+    long long playNanoseconds; // Cross-fading between filters
+    long long numSteps;
+} sndadjProfile;
+
+// A point a stream can be restarted from with sndadjSeekStream.  One is
+// reported for every step, so a table of them is an index from input time to
+// the state of the pitch search.
+typedef struct {
+    long long inputPos; // Input frame the next step starts at
+    int period; // Period of the filter centered on inputPos
+    bool voiced; // Voicing of that period, which limits the next search
+} sndadjSeekPoint;
+
+typedef void (*sndadjSeekCallback)(void *userData, const sndadjSeekPoint *point);
+
+// Called with each filter the stream computes.  The filters do not depend on
+// the speed, so they can be saved and played back later at any speed with
+// sndadjWriteLoopToStream.  samples holds period samples for each channel, with
+// channel c starting at samples[c*stride].
+typedef void (*sndadjLoopCallback)(void *userData, int stepSize, int period,
+    const short *samples, int stride);
+
+// Create a stream.  Return NULL only if we are out of memory.
+sndadjStream sndadjCreateStream(int sampleRate, int numChannels);
+// Free all the memory owned by the stream.
+void sndadjDestroyStream(sndadjStream stream);
+// Discard all input and output, and get the stream ready to process a new
+// clip.  Buffers and settings such as the speed are kept, so this is much
+// cheaper than creating a new stream.
+void sndadjResetStream(sndadjStream stream);
+// Set the playback speed.  2.0 means twice as fast, 0.5 means half speed.  The
+// speed may be changed between writes, and the change is ramped in as set by
+// sndadjSetSpeedRamp.  A speed out of range is ignored.
+void sndadjSetSpeed(sndadjStream stream, double speed);
+// Return the playback speed, or the first speed if there are several.  During a
+// ramp, this is the speed being ramped to.
+double sndadjGetSpeed(sndadjStream stream);
+// Ramp speed changes in over this many seconds of output, rather than switching
+// at once.  The default is 0, which switches at once.  Speeds set before the
+// stream starts playing, or after a reset or seek, always take effect at once.
+void sndadjSetSpeedRamp(sndadjStream stream, double seconds);
+// Return the time speed changes are ramped over, in seconds.
+double sndadjGetSpeedRamp(sndadjStream stream);
+// Play the input at several speeds at once.  The pitch search and filters are
+// computed once, and shared by every speed, so each extra speed only costs the
+// cross-fading.  Output for speed i is read with sndadjReadSamplesAtSpeed, and
+// index 0 is also what sndadjReadSamplesFromStream reads.  Set the speeds
+// before writing any samples.  Return false, leaving the speeds as they were,
+// if numSpeeds is less than 1, if any speed is out of range, or if out of
+// memory.
+bool sndadjSetSpeeds(sndadjStream stream, const double *speeds, int numSpeeds);
+// Return the number of playback speeds.
+int sndadjGetNumSpeeds(sndadjStream stream);
+// Search for the pitch period on a signal down-sampled by decimation first, and
+// then refine it at the full rate near the coarse match.  This cuts the cost of
+// the pitch search by roughly decimation squared.  Valid factors are 1 (off, the
+// default), 2 and 4.  0 picks 2 or 4 automatically from the sample rate, and
+// leaves the search at the full rate for rates below 16KHz.  Return false for
+// an invalid factor or if out of memory.
+bool sndadjSetDecimation(sndadjStream stream, int decimation);
+// Return the decimation factor of the pitch search.
+int sndadjGetDecimation(sndadjStream stream);
+// Prune the AMDF search.  Candidates are visited outward from the last period,
+// summed a block at a time, and abandoned as soon as they can't win, so most
+// cost a fraction of a full sum.  The best period is the one the full search
+// would find, but the average difference used to decide voicing is estimated
+// from a sample of the candidates, so the voicing, and the search range that
+// follows from it, can differ.  Off by default.
+void sndadjSetPrunedSearch(sndadjStream stream, bool prunedSearch);
+// Return true if the AMDF search is pruned.
+bool sndadjGetPrunedSearch(sndadjStream stream);
+// Skip the pitch search on silence and unvoiced sounds, such as fricatives.  A
+// pass over the samples around each step measures the level and the rate of
+// zero crossings, and steps that are too quiet or cross zero too often to be
+// voiced keep the last period.  Speech is often a third or more silence and
+// unvoiced sounds, so this saves as much of the search, but the output differs
+// from a full search there.  Off by default.
+void sndadjSetSkipUnvoiced(sndadjStream stream, bool skipUnvoiced);
+// Return true if silent and unvoiced steps skip the pitch search.
+bool sndadjGetSkipUnvoiced(sndadjStream stream);
+// Step through the input this many periods at a time.  The default is 1.
+// Fractions such as 0.5 overlap the filters more.  Multiples such as 2 do
+// proportionally fewer pitch searches and filters per second of input, which
+// suits high speeds, where most of each step is skipped anyway.  0 picks the
+// scale from the slowest speed: 1 up to 2X, rising to 1.5 at 3X.  A step is
+// never shorter than the fastest speed in samples, whatever the scale.  Return
+// false for a scale other than 0 below 0.25 or above 4.
+bool sndadjSetStepScale(sndadjStream stream, double stepScale);
+// Return the number of periods per step, or 0 if it is picked from the speed.
+double sndadjGetStepScale(sndadjStream stream);
+// Select the pitch estimator.  The default is SNDADJ_PITCH_AMDF.  Return false
+// for an unknown engine or if out of memory.
+bool sndadjSetPitchEngine(sndadjStream stream, sndadjPitchEngine pitchEngine);
+// Return the pitch estimator in use.
+sndadjPitchEngine sndadjGetPitchEngine(sndadjStream stream);
+// Use 16-bit filters with Q15 cross-fade ratios and 32-bit accumulators instead
+// of double precision filters.  The double path is the default, and is the
+// reference for the fixed point one.  Playback is tracked in Q16, so in fixed
+// point mode speeds are rounded to multiples of 1/65536.  Switch before writing
+// any samples.  Return false if out of memory, leaving the mode as it was.
+bool sndadjSetFixedPoint(sndadjStream stream, bool fixedPoint);
+// Return true if the stream uses fixed point filters.
+bool sndadjGetFixedPoint(sndadjStream stream);
+// Set a function to be called with every filter the stream computes, or NULL.
+void sndadjSetLoopCallback(sndadjStream stream, sndadjLoopCallback callback,
+    void *userData);
+// If analysisOnly is true, compute filters for the loop callback, but don't
+// play them, so no output is generated.
+void sndadjSetAnalysisOnly(sndadjStream stream, bool analysisOnly);
+// Play a filter saved by the loop callback, instead of writing input samples.
+// Only the cross-fading between filters is done, which is much cheaper than
+// analyzing the input.  The stream must have the same sample rate and number
+// of channels as the one that computed the filter.  Return false if the loop is
+// invalid, if its step is too short for the speed, or if out of memory.
+bool sndadjWriteLoopToStream(sndadjStream stream, int stepSize, int period,
+    const short *samples, int stride);
+// Set a function to be called with the result of every pitch search, or NULL to
+// stop tracing.  This does nothing if the library is built with
+// -DSNDADJ_NO_TRACE.
+void sndadjSetTraceCallback(sndadjStream stream, sndadjTraceCallback callback,
+    void *userData);
+// Set a function to be called with a seek point at every step, or NULL.
+void sndadjSetSeekCallback(sndadjStream stream, sndadjSeekCallback callback,
+    void *userData);
+// Discard all input and output, and restart the stream at a seek point saved
+// from an earlier pass over the same input with the same settings.  samples
+// points to input frame point->inputPos, and historyLength frames before it
+// must be valid, up to sndadjGetMaxPeriod frames.  Fewer are taken as silence,
+// which is right at the start of the input.  Write input from point->inputPos
+// on afterwards.  The pitch track from there on is the same as the first pass
+// found, and output starts within one period.  Return false, leaving the stream
+// as it was, if the seek point is invalid or historyLength is negative.
+bool sndadjSeekStream(sndadjStream stream, const sndadjSeekPoint *point,
+    const short *samples, int historyLength);
+// Fill in the time spent in each stage since the stream was created or last
+// reset.  The counters are only kept if the library is built with
+// -DSNDADJ_PROFILE, and are all 0 otherwise.
+void sndadjGetProfile(sndadjStream stream, sndadjProfile *profile);
+// Return the longest pitch period, in frames, the stream looks for.  Filters
+// are never longer than this.
+int sndadjGetMaxPeriod(sndadjStream stream);
+// Return the sample rate of the stream.
+int sndadjGetSampleRate(sndadjStream stream);
+// Return the number of channels of the stream.
+int sndadjGetNumChannels(sndadjStream stream);
+// Append input samples to the stream.  Output is generated as soon as there is
+// enough lookahead for the next pitch search.  Return false on failure.
+bool sndadjWriteSamplesToStream(sndadjStream stream, const short *samples,
+    int numSamples);
+// Generate output for all remaining input, as if the input were followed by
+// silence.  Call this once at the end, and reset the stream before writing more
+// samples.  Return false on failure.
+bool sndadjFlushStream(sndadjStream stream);
+// Return the number of output samples available to be read.
+int sndadjSamplesAvailable(sndadjStream stream);
+// Read up to maxSamples output samples.  Return the number actually read.
+int sndadjReadSamplesFromStream(sndadjStream stream, short *samples, int maxSamples);
+// Return the number of output samples available at speed speedIndex.
+int sndadjSamplesAvailableAtSpeed(sndadjStream stream, int speedIndex);
+// Read up to maxSamples output samples played at speed speedIndex.  Return the
+// number actually read.
+int sndadjReadSamplesAtSpeed(sndadjStream stream, int speedIndex, short *samples,
+    int maxSamples);
+// Return an upper bound on the number of output frames sndadjProcessBuffer can
+// generate from inputLength frames at the current speed.
+int sndadjGetMaxOutputLength(sndadjStream stream, int inputLength);
+// Speed up or slow down a whole clip in memory, with no file I/O.  The stream is
+// reset first, and the output at the first speed is written straight into the
+// caller's output buffer, which has room for maxOutput frames.  Size it with
+// sndadjGetMaxOutputLength.  A buffer just big enough for the actual output
+// also works.  Return the number of output frames, or -1 if the output doesn't
+// fit or on failure.
+int sndadjProcessBuffer(sndadjStream stream, const short *input, int inputLength,
+    short *output, int maxOutput);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,10 @@ This file supports read/write wave files.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "wave.h"
 
 #define WAVE_BUF_LEN 4096
@@ -178,7 +182,8 @@ static void expectString(
 /* Write the header of the wave file. */
 static void writeHeader(
     waveFile file,
-    int sampleRate)
+    int sampleRate,
+    int numChannels)
 {
     /* write the wav file per the wav file format */
     writeString(file, "RIFF"); /* 00 - RIFF */
@@ -189,10 +194,10 @@ static void writeHeader(
     writeString(file, "fmt "); /* 12 - fmt */
     writeInt(file, 16); /* 16 - size of this chunk */
     writeShort(file, 1); /* 20 - what is the audio format? 1 for PCM = Pulse Code Modulation */
-    writeShort(file, 1); /* 22 - mono or stereo? 1 or 2?  (or 5 or ???) */
+    writeShort(file, numChannels); /* 22 - mono or stereo? 1 or 2?  (or 5 or ???) */
     writeInt(file, sampleRate); /* 24 - samples per second (numbers per second) */
-    writeInt(file, sampleRate * 2); /* 28 - bytes per second */
-    writeShort(file, 2); /* 32 - # of bytes in one sample, for all channels */
+    writeInt(file, sampleRate * numChannels * 2); /* 28 - bytes per second */
+    writeShort(file, numChannels * 2); /* 32 - # of bytes in one sample, for all channels */
     writeShort(file, 16); /* 34 - how many bits in a sample(number)?  usually 16 or 24 */
     writeString(file, "data"); /* 36 - data */
     writeInt(file, 0); /* 40 - how big is this data chunk */
@@ -287,7 +292,7 @@ waveFile openOutputWaveFile(
     file->soundFile = soundFile;
     file->sampleRate = sampleRate;
     file->numChannels = numChannels;
-    writeHeader(file, sampleRate);
+    writeHeader(file, sampleRate, numChannels);
     if(file->failed) {
         closeFile(file);
         return NULL;
@@ -380,3 +385,154 @@ int writeToWaveFile(
     }
     return file->failed;
 }
+
+struct mappedWaveFileStruct {
+    unsigned char *data; /* The whole mapped file */
+    size_t length;
+    short *samples; /* Points into data, unless we had to convert */
+    int numSamples; /* In frames */
+    int allocated; /* True if samples was allocated rather than mapped */
+};
+
+/* Read a little endian integer from memory. */
+static unsigned int getLittleEndian(
+    unsigned char *bytes,
+    int length)
+{
+    unsigned int value = 0;
+    int i;
+
+    for(i = length - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+/* Return true if this host stores shorts in little endian order. */
+static int isLittleEndian(void)
+{
+    short value = 1;
+
+    return *(unsigned char *)&value == 1;
+}
+
+/* Find the fmt and data chunks of a mapped wave file, skipping any others.
+   Return 0 if it is not a 16-bit PCM wave file. */
+static int parseMappedHeader(
+    mappedWaveFile file,
+    int *sampleRate,
+    int *numChannels)
+{
+    unsigned char *data = file->data;
+    size_t pos = 12, chunkLength;
+    int haveFormat = 0;
+
+    if(file->length < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+        return 0;
+    }
+    while(pos + 8 <= file->length) {
+        chunkLength = getLittleEndian(data + pos + 4, 4);
+        if(!memcmp(data + pos, "fmt ", 4)) {
+            if(chunkLength < 16 || pos + 8 + 16 > file->length ||
+                    getLittleEndian(data + pos + 8, 2) != 1 ||
+                    getLittleEndian(data + pos + 22, 2) != 16) {
+                return 0;
+            }
+            *numChannels = getLittleEndian(data + pos + 10, 2);
+            *sampleRate = getLittleEndian(data + pos + 12, 4);
+            haveFormat = *numChannels > 0;
+        } else if(!memcmp(data + pos, "data", 4)) {
+            if(!haveFormat) {
+                return 0;
+            }
+            pos += 8;
+            /* The size is often wrong in files that were never closed properly. */
+            if(chunkLength > file->length - pos) {
+                chunkLength = file->length - pos;
+            }
+            file->samples = (short *)(data + pos);
+            file->numSamples = chunkLength/(2*(*numChannels));
+            return 1;
+        }
+        pos += 8 + chunkLength + (chunkLength & 1);
+    }
+    return 0;
+}
+
+/* Map a 16-bit wave file into memory.  Return NULL without printing anything if
+   the file can't be opened, mapped or parsed, so callers can fall back on
+   openInputWaveFile, which reports the problem. */
+mappedWaveFile openMappedWaveFile(
+    char *fileName,
+    int *sampleRate,
+    int *numChannels)
+{
+    mappedWaveFile file;
+    struct stat status;
+    unsigned char *bytes;
+    short *samples;
+    int fd, i, total;
+
+    fd = open(fileName, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+    if(fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    bytes = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(bytes == MAP_FAILED) {
+        return NULL;
+    }
+    file = (mappedWaveFile)calloc(1, sizeof(struct mappedWaveFileStruct));
+    if(file == NULL) {
+        munmap(bytes, status.st_size);
+        return NULL;
+    }
+    file->data = bytes;
+    file->length = status.st_size;
+    if(!parseMappedHeader(file, sampleRate, numChannels)) {
+        closeMappedWaveFile(file);
+        return NULL;
+    }
+    madvise(bytes, file->length, MADV_SEQUENTIAL);
+    if(!isLittleEndian() || ((size_t)file->samples & 1) != 0) {
+        /* We can't use the data in place, so convert it. */
+        total = file->numSamples*(*numChannels);
+        samples = (short *)malloc(total*sizeof(short) + 1); /* Never malloc(0) */
+        if(samples == NULL) {
+            closeMappedWaveFile(file);
+            return NULL;
+        }
+        bytes = (unsigned char *)file->samples;
+        for(i = 0; i < total; i++) {
+            samples[i] = (short)getLittleEndian(bytes + 2*i, 2);
+        }
+        file->samples = samples;
+        file->allocated = 1;
+    }
+    return file;
+}
+
+/* Return the samples of a mapped wave file, and set *numSamples to the number
+   of frames. */
+const short *getMappedWaveSamples(
+    mappedWaveFile file,
+    int *numSamples)
+{
+    *numSamples = file->numSamples;
+    return file->samples;
+}
+
+/* Unmap the file and free the mappedWaveFile. */
+void closeMappedWaveFile(
+    mappedWaveFile file)
+{
+    if(file->allocated) {
+        free(file->samples);
+    }
+    munmap(file->data, file->length);
+    free(file);
+}
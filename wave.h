@@ -27,3 +27,11 @@ waveFile openOutputWaveFile(char *fileName, int sampleRate, int numChannels);
 int closeWaveFile(waveFile file);
 int readFromWaveFile(waveFile file, short *buffer, int maxSamples);
 int writeToWaveFile(waveFile file, short *buffer, int numSamples);
+
+/* Memory mapped input.  The samples of a 16-bit PCM file are used in place on
+   little-endian hosts, with no copying. */
+typedef struct mappedWaveFileStruct *mappedWaveFile;
+
+mappedWaveFile openMappedWaveFile(char *fileName, int *sampleRate, int *numChannels);
+const short *getMappedWaveSamples(mappedWaveFile file, int *numSamples);
+void closeMappedWaveFile(mappedWaveFile file);